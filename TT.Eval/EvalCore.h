@@ -3,19 +3,59 @@
 #define EVALCORE_H_HPP
 #include <vector>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <stack>
 #include <memory>
 #include <set>
+#include <map>
+#include <unordered_set>
+#include <unordered_map>
+#include <queue>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <atomic>
+#include <deque>
+#include <bitset>
 #include <functional>
+#include <charconv>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EVALCORE_SSE2
+#endif
 
 template <typename T>
 using sp = std::shared_ptr<T>;
 
-#define is_branch(x) x->Depth() > 0
-#define is_value(x) x->Depth() == 0
-#define as_branch(x) std::dynamic_pointer_cast<Branch>(x)
-#define as_value(x) std::dynamic_pointer_cast<Value>(x)
+class Slot;
+
+template<typename T, typename P>
+bool NodeIs(const P& node)
+{
+    return dynamic_cast<const T*>(&*node) != nullptr;
+}
+template<typename T>
+bool NodeIs(const Slot& slot);
+
+template<typename T, typename P>
+sp<T> NodeAs(const P& node)
+{
+    return std::dynamic_pointer_cast<T>(node);
+}
+template<typename T>
+sp<T> NodeAs(const Slot& slot);
+
+#define is_branch(x) NodeIs<Branch>(x)
+#define is_value(x) NodeIs<Value>(x)
+#define as_branch(x) NodeAs<Branch>(x)
+#define as_value(x) NodeAs<Value>(x)
 
 #pragma region Exceptions
 class ExecutionEngineException : public std::exception
@@ -88,28 +128,406 @@ class BranchBase
 public:
     virtual unsigned int Depth() const noexcept = 0;
     virtual sp<BranchBase> Copy() const noexcept = 0;
+    // Structural hash and equality, two trees are equal when they hold the same values in the same shape
+    virtual size_t Hash() const noexcept = 0;
+    virtual bool Equals(const BranchBase& other) const noexcept = 0;
 };
 
-class Branch : public BranchBase
+// Data stack entry holding a node or, for short text, the characters themselves. An immediate is boxed into
+// a Value the first time it is used as a node, when it is packed into a branch for instance.
+class Slot
 {
 public:
-    std::vector<sp<BranchBase>> Branches{};
+    static constexpr size_t ImmediateCapacity = 15;
 
-    Branch() noexcept = default;
-    Branch(std::stack<sp<BranchBase>>& stack, int taken) noexcept
+    Slot() noexcept = default;
+    template<typename T>
+    Slot(sp<T> node) noexcept : node_(std::move(node)) {}
+
+    // Short text stays in the slot, longer text becomes a node
+    static Slot Text(std::string_view text);
+
+    bool IsImmediate() const noexcept
+    {
+        return size_ != NodeTag;
+    }
+
+    // Text of an immediate or of a value node, empty for branches
+    std::string_view View() const noexcept;
+
+    const sp<BranchBase>& Node() const
+    {
+        if (IsImmediate())
+            Box();
+        return node_;
+    }
+
+    operator const sp<BranchBase>&() const
+    {
+        return Node();
+    }
+
+    BranchBase* operator->() const
+    {
+        return Node().get();
+    }
+
+    BranchBase& operator*() const
+    {
+        return *Node();
+    }
+
+    BranchBase* get() const
+    {
+        return Node().get();
+    }
+
+    long use_count() const noexcept
+    {
+        return IsImmediate() ? 1 : node_.use_count();
+    }
+
+    sp<BranchBase> Take()
+    {
+        Node();
+        return std::move(node_);
+    }
+
+    // Immediates are copied as they are, nodes through Copy()
+    Slot Clone() const;
+
+private:
+    static constexpr unsigned char NodeTag = 0xFF;
+
+    mutable sp<BranchBase> node_{};
+    char text_[ImmediateCapacity]{};
+    mutable unsigned char size_{ NodeTag };
+
+    void Box() const;
+};
+
+// Slots live in a vector, so a push may move all of them: builtins hold the node (sp) rather than a
+// reference or a text view into a slot when they push while still using it
+class DataStack : public std::stack<Slot, std::vector<Slot>>
+{
+public:
+    std::vector<Slot>& Container() noexcept
+    {
+        return c;
+    }
+};
+
+// Bump allocator for nodes: memory is handed out in chunks and released all at once with the arena
+class NodeArena
+{
+public:
+    static inline size_t ChunkSize = 1 << 20;
+
+    void* Allocate(size_t size, size_t align)
     {
-        Branches.resize(taken);
-        for (int i = taken - 1; i > -1; i--)
+        size_t pad = (align - (size_t)next_ % align) % align;
+        if (pad + size > left_)
         {
-            Branches[i] = stack.top();
-            stack.pop();
+            size_t chunk = std::max(ChunkSize, size + align);
+            chunks_.emplace_back(new char[chunk]);
+            next_ = chunks_.back().get();
+            left_ = chunk;
+            pad = (align - (size_t)next_ % align) % align;
         }
+        void* res = next_ + pad;
+        next_ += pad + size;
+        left_ -= pad + size;
+        used_ += size;
+        return res;
     }
 
-    void Unpack(std::stack<sp<BranchBase>>& stack)
+    size_t Used() const noexcept
     {
-        for (auto i : Branches)
-            stack.push(i->Copy());
+        return used_;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> chunks_{};
+    char* next_{ nullptr };
+    size_t left_{ 0 };
+    size_t used_{ 0 };
+};
+
+// Allocator for allocate_shared reserving Extra bytes after the object in the same block, the address
+// of those bytes is written to *Tail before the object is constructed. With an arena the block comes from
+// it and the control block's copy of the allocator keeps the arena alive.
+template<typename T>
+struct TailAllocator
+{
+    using value_type = T;
+
+    size_t Extra;
+    char** Tail;
+    sp<NodeArena> Arena;
+
+    TailAllocator(size_t extra, char** tail, sp<NodeArena> arena = nullptr) noexcept : Extra(extra), Tail(tail), Arena(std::move(arena)) {}
+    template<typename U>
+    TailAllocator(const TailAllocator<U>& other) noexcept : Extra(other.Extra), Tail(other.Tail), Arena(other.Arena) {}
+
+    T* allocate(size_t n)
+    {
+        size_t size = n * sizeof(T) + Extra;
+        char* block = static_cast<char*>(Arena != nullptr ? Arena->Allocate(size, alignof(T)) : ::operator new(size));
+        *Tail = block + n * sizeof(T);
+        return reinterpret_cast<T*>(block);
+    }
+
+    void deallocate(T* p, size_t) noexcept
+    {
+        if (Arena == nullptr)
+            ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator==(const TailAllocator<U>& other) const noexcept
+    {
+        return Extra == other.Extra && Arena == other.Arena;
+    }
+
+    template<typename U>
+    bool operator!=(const TailAllocator<U>& other) const noexcept
+    {
+        return !(*this == other);
+    }
+};
+
+// Vector keeping up to N elements inside the object, it moves to the heap only once it grows past them
+template<typename T, size_t N>
+class SmallVector
+{
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector() noexcept = default;
+
+    SmallVector(const SmallVector& other)
+    {
+        assign(other.begin(), other.end());
+    }
+
+    SmallVector(SmallVector&& other)
+    {
+        Take(other);
+    }
+
+    SmallVector& operator=(const SmallVector& other)
+    {
+        if (this != &other)
+            assign(other.begin(), other.end());
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other)
+    {
+        if (this != &other)
+        {
+            Release();
+            Take(other);
+        }
+        return *this;
+    }
+
+    ~SmallVector()
+    {
+        Release();
+    }
+
+    size_t size() const noexcept { return size_; }
+    size_t capacity() const noexcept { return capacity_; }
+    bool empty() const noexcept { return size_ == 0; }
+    bool IsInline() const noexcept { return data_ == Inline(); }
+    bool IsBorrowed() const noexcept { return borrowed_; }
+    T* data() noexcept { return data_; }
+    const T* data() const noexcept { return data_; }
+    iterator begin() noexcept { return data_; }
+    iterator end() noexcept { return data_ + size_; }
+    const_iterator begin() const noexcept { return data_; }
+    const_iterator end() const noexcept { return data_ + size_; }
+    T& operator[](size_t i) noexcept { return data_[i]; }
+    const T& operator[](size_t i) const noexcept { return data_[i]; }
+    T& back() noexcept { return data_[size_ - 1]; }
+    const T& back() const noexcept { return data_[size_ - 1]; }
+
+    void reserve(size_t n)
+    {
+        if (n <= capacity_)
+            return;
+        T* fresh = std::allocator<T>().allocate(n);
+        std::uninitialized_move(data_, data_ + size_, fresh);
+        std::destroy(data_, data_ + size_);
+        Deallocate();
+        data_ = fresh;
+        capacity_ = n;
+    }
+
+    // Storage owned elsewhere (an arena) used until the vector outgrows it, only valid while empty
+    void UseStorage(T* storage, size_t capacity) noexcept
+    {
+        Release();
+        data_ = storage;
+        capacity_ = capacity;
+        borrowed_ = true;
+    }
+
+    void resize(size_t n)
+    {
+        if (n > size_)
+        {
+            reserve(n);
+            std::uninitialized_value_construct(data_ + size_, data_ + n);
+        }
+        else
+            std::destroy(data_ + n, data_ + size_);
+        size_ = n;
+    }
+
+    void clear() noexcept
+    {
+        std::destroy(data_, data_ + size_);
+        size_ = 0;
+    }
+
+    // The new element is built before the old ones move, so arguments may refer into the vector
+    template<typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        if (size_ < capacity_)
+        {
+            new (data_ + size_) T(std::forward<Args>(args)...);
+            return data_[size_++];
+        }
+        size_t grown = capacity_ * 2;
+        T* fresh = std::allocator<T>().allocate(grown);
+        new (fresh + size_) T(std::forward<Args>(args)...);
+        std::uninitialized_move(data_, data_ + size_, fresh);
+        std::destroy(data_, data_ + size_);
+        Deallocate();
+        data_ = fresh;
+        capacity_ = grown;
+        return data_[size_++];
+    }
+
+    void push_back(const T& item) { emplace_back(item); }
+    void push_back(T&& item) { emplace_back(std::move(item)); }
+
+    void pop_back() noexcept
+    {
+        std::destroy_at(data_ + --size_);
+    }
+
+    template<typename It>
+    void assign(It first, It last)
+    {
+        clear();
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>)
+            reserve(std::distance(first, last));
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+
+    iterator insert(const_iterator pos, T item)
+    {
+        size_t index = pos - data_;
+        emplace_back(std::move(item));
+        std::rotate(data_ + index, data_ + size_ - 1, data_ + size_);
+        return data_ + index;
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        size_t index = pos - data_;
+        std::move(data_ + index + 1, data_ + size_, data_ + index);
+        pop_back();
+        return data_ + index;
+    }
+
+private:
+    T* data_{ Inline() };
+    size_t size_{ 0 };
+    size_t capacity_{ N };
+    bool borrowed_{ false };
+    alignas(T) unsigned char inline_[N * sizeof(T)];
+
+    T* Inline() noexcept { return reinterpret_cast<T*>(inline_); }
+    const T* Inline() const noexcept { return reinterpret_cast<const T*>(inline_); }
+
+    void Deallocate() noexcept
+    {
+        if (!IsInline() && !borrowed_)
+            std::allocator<T>().deallocate(data_, capacity_);
+        borrowed_ = false;
+    }
+
+    void Release() noexcept
+    {
+        clear();
+        Deallocate();
+        data_ = Inline();
+        capacity_ = N;
+    }
+
+    // Heap storage is stolen, inline and borrowed elements are moved one by one
+    void Take(SmallVector& other)
+    {
+        if (other.IsInline() || other.borrowed_)
+        {
+            reserve(other.size_);
+            std::uninitialized_move(other.data_, other.data_ + other.size_, data_);
+            size_ = other.size_;
+            other.clear();
+            return;
+        }
+        data_ = other.data_;
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        borrowed_ = other.borrowed_;
+        other.data_ = other.Inline();
+        other.size_ = 0;
+        other.capacity_ = N;
+        other.borrowed_ = false;
+    }
+};
+
+class Branch : public BranchBase
+{
+public:
+    // Rows are mostly a handful of fields, those fit in the node itself
+    static constexpr size_t InlineChildren = 8;
+
+    SmallVector<sp<BranchBase>, InlineChildren> Branches{};
+
+    Branch() noexcept = default;
+    Branch(DataStack& stack, int taken) noexcept
+    {
+        auto& c = stack.Container();
+        Branches.reserve(taken);
+        for (auto it = c.end() - taken; it != c.end(); ++it)
+            Branches.push_back(it->Take());
+        c.erase(c.end() - taken, c.end());
+    }
+
+    // Node with room for children right behind it, both from the arena when one is given
+    static sp<Branch> Make(size_t children, const sp<NodeArena>& arena = nullptr)
+    {
+        char* tail = nullptr;
+        size_t extra = children > InlineChildren ? children * sizeof(sp<BranchBase>) : 0;
+        auto res = std::allocate_shared<Branch>(TailAllocator<Branch>(extra, &tail, arena));
+        if (extra > 0)
+            res->Branches.UseStorage(reinterpret_cast<sp<BranchBase>*>(tail), children);
+        return res;
+    }
+
+    void Unpack(DataStack& stack)
+    {
+        auto& c = stack.Container();
+        c.insert(c.end(), std::make_move_iterator(Branches.begin()), std::make_move_iterator(Branches.end()));
         Branches.clear();
     }
 
@@ -130,19 +548,111 @@ public:
             res->Branches[i] = Branches[i]->Copy();
         return res;
     }
+
+    size_t Hash() const noexcept override
+    {
+        size_t res = Branches.size() ^ 0x9e3779b97f4a7c15ull;
+        for (auto& i : Branches)
+            res ^= i->Hash() + 0x9e3779b97f4a7c15ull + (res << 6) + (res >> 2);
+        return res;
+    }
+
+    bool Equals(const BranchBase& other) const noexcept override
+    {
+        auto br = dynamic_cast<const Branch*>(&other);
+        if (br == nullptr || br->Branches.size() != Branches.size())
+            return false;
+        for (size_t i = 0; i < Branches.size(); i++)
+            if (Branches[i] != br->Branches[i] && !Branches[i]->Equals(*br->Branches[i]))
+                return false;
+        return true;
+    }
 };
 
 class Value : public BranchBase
 {
 public:
-    std::string Stored{ "" };
+    // Non text values hold a binary payload produced by the operation that made them
+    enum class Encoding : unsigned char
+    {
+        Text,
+        Sketch,
+        Int64,
+        Float64,
+        Dictionary,
+        Compressed,
+    };
+
+    Encoding Kind{ Encoding::Text };
+
+    // Ranges shorter than SliceInline are copied into their own node rather than pinning the parent.
+    // Copying a slice detaches it when the parent is more than SliceDetachRatio times larger than the slice.
+    static inline size_t SliceInline = 16;
+    static inline size_t SliceDetachRatio = 64;
 
     Value() noexcept = default;
-    Value(const std::string& row) noexcept : Stored(row) {}
+    Value(const std::string& row) noexcept : text_(row) {}
+    Value(std::string&& row) noexcept : text_(std::move(row)) {}
+    Value(const std::string& payload, Encoding kind) noexcept : Kind(kind), text_(payload) {}
+    Value(std::string&& payload, Encoding kind) noexcept : Kind(kind), text_(std::move(payload)) {}
+    Value(sp<const Value> parent, std::string_view range) noexcept : parent_(std::move(parent)), slice_(range), external_(true) {}
+    // Copies text to the bytes *tail points at, Make reserves them behind the node
+    Value(std::string_view text, Encoding kind, char** tail) noexcept : Kind(kind), slice_(*tail, text.size()), external_(true)
+    {
+        if (text.size() > 0)
+            std::memcpy(*tail, text.data(), text.size());
+    }
+
+    // Inline characters belong to the node they were allocated with, a copy takes its own
+    Value(const Value& other) : BranchBase(other), Kind(other.Kind), text_(other.text_), parent_(other.parent_), slice_(other.slice_), external_(other.external_)
+    {
+        if (external_ && parent_ == nullptr)
+            Own();
+    }
+    Value& operator=(const Value&) = delete;
+
+    // Node, control block and characters in one allocation
+    static sp<Value> Make(std::string_view text, Encoding kind = Encoding::Text, const sp<NodeArena>& arena = nullptr)
+    {
+        char* tail = nullptr;
+        return std::allocate_shared<Value>(TailAllocator<Value>(text.size(), &tail, arena), text, kind, &tail);
+    }
+
+    // Text referencing [offset, offset + size) of of's text, slices of slices reference the original parent
+    static sp<Value> Slice(const sp<const Value>& of, size_t offset, size_t size)
+    {
+        std::string_view range = of->View().substr(offset, size);
+        if (range.size() < SliceInline)
+            return Make(range);
+        return std::make_shared<Value>(of->parent_ != nullptr ? of->parent_ : of, range);
+    }
 
     bool IsEmpty()
     {
-        return Stored.size() == 0 || Stored == "";
+        return View().size() == 0;
+    }
+
+    bool IsSlice() const noexcept
+    {
+        return parent_ != nullptr;
+    }
+
+    std::string_view View() const noexcept
+    {
+        return external_ ? slice_ : std::string_view(text_);
+    }
+
+    // Writable text, slices and inline characters are copied out first
+    std::string& Own()
+    {
+        if (external_)
+        {
+            text_.assign(slice_);
+            parent_.reset();
+            slice_ = {};
+            external_ = false;
+        }
+        return text_;
     }
 
     unsigned int Depth() const noexcept override
@@ -152,18 +662,179 @@ public:
 
     sp<BranchBase> Copy() const noexcept override
     {
-        return std::make_shared<Value>(Stored);
+        if (parent_ != nullptr && slice_.size() * SliceDetachRatio >= parent_->View().size())
+            return std::make_shared<Value>(parent_, slice_);
+        return Make(View(), Kind);
+    }
+
+    size_t Hash() const noexcept override
+    {
+        return std::hash<std::string_view>{}(View());
+    }
+
+    bool Equals(const BranchBase& other) const noexcept override
+    {
+        auto v = dynamic_cast<const Value*>(&other);
+        return v != nullptr && v->Kind == Kind && v->View() == View();
     }
 
     template<typename TargetType>
     TargetType ReadAs()
     {
-        TargetType res;
-        std::stringstream s(Stored);
+        return Read<TargetType>(View());
+    }
+
+    // Integers that from_chars reads whole skip the stream
+    template<typename TargetType>
+    static TargetType Read(std::string_view text)
+    {
+        TargetType res{};
+        if constexpr (std::is_integral_v<TargetType>)
+        {
+            auto r = std::from_chars(text.data(), text.data() + text.size(), res);
+            if (r.ec == std::errc() && r.ptr == text.data() + text.size())
+                return res;
+        }
+        std::stringstream s{ std::string(text) };
         s >> res;
         return res;
     }
+
+private:
+    std::string text_{};
+    sp<const Value> parent_{};
+    std::string_view slice_{};
+    bool external_{ false };
+};
+
+inline void Slot::Box() const
+{
+    node_ = Value::Make(std::string_view(text_, size_));
+    size_ = NodeTag;
+}
+
+inline Slot Slot::Text(std::string_view text)
+{
+    if (text.size() > ImmediateCapacity)
+        return Slot(Value::Make(text));
+    Slot res;
+    if (text.size() > 0)
+        std::memcpy(res.text_, text.data(), text.size());
+    res.size_ = (unsigned char)text.size();
+    return res;
+}
+
+inline std::string_view Slot::View() const noexcept
+{
+    if (IsImmediate())
+        return std::string_view(text_, size_);
+    auto v = dynamic_cast<const Value*>(node_.get());
+    return v != nullptr ? v->View() : std::string_view();
+}
+
+inline Slot Slot::Clone() const
+{
+    return IsImmediate() ? *this : Slot(node_->Copy());
+}
+
+template<typename T>
+bool NodeIs(const Slot& slot)
+{
+    if (slot.IsImmediate())
+        return std::is_same_v<T, Value>;
+    return NodeIs<T>(slot.Node());
+}
+
+template<typename T>
+sp<T> NodeAs(const Slot& slot)
+{
+    return std::dynamic_pointer_cast<T>(slot.Node());
+}
+
+#pragma region Compaction
+// Where the nodes of a tree sit relative to its depth-first order
+struct Fragmentation
+{
+    size_t Nodes{ 0 };
+    size_t Span{ 0 };
+    double MeanStride{ 0 };
+    size_t FarJumps{ 0 };
+};
+
+// Relocates a tree into a fresh arena in depth-first order, so memory order matches traversal order.
+// Shared subtrees stay shared and slices are copied out, releasing the buffers they pinned.
+class TreeCompactor
+{
+public:
+    // Page is the distance above which two consecutive nodes count as a far jump
+    static inline size_t Page = 4096;
+
+    static sp<BranchBase> Compact(const sp<BranchBase>& root)
+    {
+        TreeCompactor compactor;
+        return compactor.Move(root);
+    }
+
+    static Fragmentation Measure(const sp<BranchBase>& root)
+    {
+        Fragmentation res;
+        uintptr_t low = UINTPTR_MAX, high = 0, last = 0;
+        double strides = 0;
+        std::vector<const BranchBase*> stack{ root.get() };
+        while (stack.size() > 0)
+        {
+            const BranchBase* node = stack.back();
+            stack.pop_back();
+            uintptr_t at = reinterpret_cast<uintptr_t>(node);
+            if (res.Nodes > 0)
+            {
+                uintptr_t stride = at > last ? at - last : last - at;
+                strides += (double)stride;
+                if (stride > Page)
+                    res.FarJumps++;
+            }
+            res.Nodes++;
+            last = at;
+            low = std::min(low, at);
+            high = std::max(high, at);
+            if (auto br = dynamic_cast<const Branch*>(node))
+                for (size_t i = br->Branches.size(); i > 0; i--)
+                    stack.push_back(br->Branches[i - 1].get());
+        }
+        res.Span = high - low;
+        res.MeanStride = res.Nodes > 1 ? strides / (res.Nodes - 1) : 0;
+        return res;
+    }
+
+private:
+    sp<NodeArena> arena_{ std::make_shared<NodeArena>() };
+    std::unordered_map<const BranchBase*, sp<BranchBase>> moved_{};
+
+    sp<BranchBase> Move(const sp<BranchBase>& node)
+    {
+        if (node.use_count() > 1)
+        {
+            auto it = moved_.find(node.get());
+            if (it != moved_.end())
+                return it->second;
+        }
+        sp<BranchBase> res;
+        if (auto v = dynamic_cast<const Value*>(node.get()))
+            res = Value::Make(v->View(), v->Kind, arena_);
+        else
+        {
+            auto& src = static_cast<const Branch*>(node.get())->Branches;
+            auto br = Branch::Make(src.size(), arena_);
+            for (auto& child : src)
+                br->Branches.push_back(Move(child));
+            res = br;
+        }
+        if (node.use_count() > 1)
+            moved_.emplace(node.get(), res);
+        return res;
+    }
 };
+#pragma endregion
 
 class BranchStream
 {
@@ -174,6 +845,7 @@ private:
 public:
     std::string Space = "\t";
     std::string Section = "./section";
+    std::string Encoded = "./encoded";
     std::string ValueEnd = "\n";
 
     BranchStream(std::ostream& out) : out_(out) {}
@@ -182,7 +854,10 @@ public:
     {
         for (int i = 0; i < depth_; i++)
             out_ << Space;
-        out_ << value->Stored << ValueEnd;
+        if (value->Kind == Value::Encoding::Text)
+            out_ << value->View() << ValueEnd;
+        else
+            out_ << Encoded << ValueEnd;
         return *this;
     }
 
@@ -208,507 +883,4962 @@ public:
     }
 };
 
-class Evaluator
+#pragma region Path
+struct SliceBounds
 {
-public:
-    using Function = std::function<void(Evaluator* eval)>;
-    struct FuncDef
-    {
-        Function Func;
-        std::string Name;
+    int From{ 0 };
+    int To{ 0 };
+    int Step{ 1 };
+    bool HasFrom{ false };
+    bool HasTo{ false };
 
-        FuncDef(Function f, std::string n) : Func(f), Name(n) {}
+    // Clamps the bounds against size the way Python does, returns how many positions are selected
+    int Resolve(int size, int& start) const noexcept
+    {
+        int low = Step > 0 ? 0 : -1;
+        int high = Step > 0 ? size : size - 1;
+        int from = From < 0 ? From + size : From;
+        int to = To < 0 ? To + size : To;
+        if (!HasFrom)
+            from = Step > 0 ? low : high;
+        from = std::min(std::max(from, low), high);
+        if (!HasTo)
+            to = Step > 0 ? high : low;
+        to = std::min(std::max(to, low), high);
+        start = from;
+        if (Step > 0 && to > from)
+            return (to - from + Step - 1) / Step;
+        if (Step < 0 && from > to)
+            return (from - to - Step - 1) / -Step;
+        return 0;
+    }
+};
 
-        bool operator<(const FuncDef& other) const noexcept
+// Selector syntax, steps are separated by '/' and each one picks children of the branches matched so far:
+//   *       every child, may be left out in front of a filter
+//   n       child n, negative counts from the end
+//   a:b:s   slice of children, any part may be omitted
+//   [k=X]   suffix keeping only children whose child k is the value X, [=X] compares the child itself, != negates
+// Only branches are descended into, so "*/::3[0=X]" is every 3rd row at depth 2 whose first field is X.
+class PathProgram
+{
+public:
+    struct Step
+    {
+        enum class Filter
         {
-            return Name < other.Name;
+            None,
+            Self,
+            Field,
+        };
+
+        SliceBounds Pick{};
+        bool Index{ false };
+        Filter Test{ Filter::None };
+        int Field{ 0 };
+        bool Negate{ false };
+        std::string Equals{};
+
+        int Resolve(int size, int& start) const noexcept
+        {
+            if (!Index)
+                return Pick.Resolve(size, start);
+            start = Pick.From < 0 ? Pick.From + size : Pick.From;
+            return start >= 0 && start < size ? 1 : 0;
         }
-        bool operator==(const FuncDef& other) const noexcept
+
+        bool Accepts(const sp<BranchBase>& node) const noexcept
         {
-            return Name == other.Name;
+            const BranchBase* tested = node.get();
+            if (Test == Filter::None)
+                return true;
+            if (Test == Filter::Field)
+            {
+                auto br = dynamic_cast<const Branch*>(tested);
+                tested = br != nullptr && Field < br->Branches.size() ? br->Branches[Field].get() : nullptr;
+            }
+            auto v = dynamic_cast<const Value*>(tested);
+            return (v != nullptr && v->View() == Equals) != Negate;
         }
     };
 
-    std::set<FuncDef> Functions;
-    std::stack<sp<BranchBase>> Data;
-    std::stack<std::string> Log;
+    std::vector<Step> Steps{};
 
-    ExecutionEngineException::Level ApprovedLevel;
+    static sp<const PathProgram> Compile(std::string_view text)
+    {
+        auto res = std::make_shared<PathProgram>();
+        size_t p = 0;
+        do
+        {
+            size_t e = p;
+            bool filter = false;
+            for (; e < text.size(); e++)
+            {
+                if (!filter && text[e] == '/')
+                    break;
+                if (text[e] == '[')
+                    filter = true;
+                else if (filter && text[e] == ']' && (e + 1 == text.size() || text[e + 1] == '/'))
+                    filter = false;
+            }
+            if (filter)
+                SyntaxError();
+            res->Steps.push_back(CompileStep(text.substr(p, e - p)));
+            p = e + 1;
+        } while (p <= text.size());
+        return res;
+    }
 
-    Evaluator() {}
+    // Program of ExtractColumnPack: child index of every branch found depth - 1 levels below the root
+    static sp<const PathProgram> Column(int depth, int index)
+    {
+        auto res = std::make_shared<PathProgram>();
+        res->Steps.resize(depth);
+        res->Steps.back().Index = true;
+        res->Steps.back().Pick.From = index;
+        return res;
+    }
 
-    void LoadDefault()
+private:
+    static void SyntaxError()
     {
-        // ^ - pack operation
-        // t - top only operation
-        // c - count argument
-        // d - depth argument
-        // i - index argument
-        // g - grouped operation
-        // _ - reverse operation
-        // | - generative operation
-        // M - math operations
-        // Y - tree operations
-        // S - statistics operations
-        // ? - logical operations
-        // # - remove operation
-        // $ - row operation
-        Functions.insert({ PackTop, "^t" });
-        Functions.insert({ PackTopSameLevel, "^" });
-        Functions.insert({ UnpackTop, "^_t" });
-        Functions.insert({ PackTopX, "^tc" });
+        ExecutionEngineException::ThrowWraped("Selector syntax error", ExecutionEngineException::Level::Critical);
+    }
 
-        Functions.insert({ EmptyBranch, "|Eb" });
-        Functions.insert({ EmptyElement , "|Ev" });
-        Functions.insert({ CopyFromIndex, "|i" });
-        Functions.insert({ ExtractColumnPack, "|id" }) ;
-        Functions.insert({ CopyFromIndex, "|[" });
-        Functions.insert({ ExtractColumnPack, "|]" }) ;
-        Functions.insert({ ExtractGroupedColumnPack, "|]g" }) ;
+    static int ReadInt(std::string_view text)
+    {
+        int res = 0;
+        auto r = std::from_chars(text.data(), text.data() + text.size(), res);
+        if (text.size() == 0 || r.ec != std::errc() || r.ptr != text.data() + text.size())
+            SyntaxError();
+        return res;
+    }
 
-        Functions.insert({ Copy, "|" });
-        Functions.insert({ Duplicate, "|c" });
+    static Step CompileStep(std::string_view text)
+    {
+        Step res;
+        size_t f = text.find('[');
+        std::string_view pick = text.substr(0, f);
+        if (f != std::string_view::npos)
+        {
+            std::string_view test = text.substr(f + 1, text.size() - f - 2);
+            size_t eq = test.find('=');
+            if (eq == std::string_view::npos)
+                SyntaxError();
+            res.Equals = test.substr(eq + 1);
+            test = test.substr(0, eq);
+            if (test.size() > 0 && test.back() == '!')
+            {
+                res.Negate = true;
+                test.remove_suffix(1);
+            }
+            res.Test = test.size() == 0 ? Step::Filter::Self : Step::Filter::Field;
+            if (res.Test == Step::Filter::Field && (res.Field = ReadInt(test)) < 0)
+                SyntaxError();
+        }
+        if (pick == "*" || pick.size() == 0)
+            return res;
+        size_t c = pick.find(':');
+        if (c == std::string_view::npos)
+        {
+            res.Index = true;
+            res.Pick.From = ReadInt(pick);
+            return res;
+        }
+        std::string_view from = pick.substr(0, c);
+        pick = pick.substr(c + 1);
+        c = pick.find(':');
+        std::string_view to = pick.substr(0, c);
+        if ((res.Pick.HasFrom = from.size() > 0))
+            res.Pick.From = ReadInt(from);
+        if ((res.Pick.HasTo = to.size() > 0))
+            res.Pick.To = ReadInt(to);
+        if (c != std::string_view::npos && pick.size() > c + 1)
+            res.Pick.Step = ReadInt(pick.substr(c + 1));
+        if (res.Pick.Step == 0)
+            SyntaxError();
+        return res;
+    }
+};
 
-        Functions.insert({ [](Evaluator* eval) { eval->Data.pop(); }, "#" });
-        Functions.insert({ DeepRemove, "#d" });
+// Lazily walks a tree with a compiled selector, Enter/Leave report every branch descended into
+class PathCursor
+{
+public:
+    enum class Event
+    {
+        Enter,
+        Match,
+        Leave,
+        End,
+    };
 
-        Functions.insert({ Undot, "$" });
-        Functions.insert({ ConcatRow, "$^" });
-        Functions.insert({ SplitRow, "$_" });
+    sp<BranchBase> Current{};
 
-        Functions.insert({ Reverse, "_" });
+    PathCursor(sp<const PathProgram> program, sp<Branch> root) : program_(program)
+    {
+        if (program_->Steps.size() > 0)
+            Push(root);
     }
 
-    void EvalCom(std::string com, bool log = true, bool catch_localy = true)
+    Event Next()
     {
-        try
+        while (frames_.size() > 0)
         {
-            if (com.size() < 1)
-                return;
-            auto it = Functions.find({ nullptr,com });
-            if (it == Functions.end())
-                Data.push(std::make_shared<Value>(com));
-            else
-                it->Func(this);
+            Frame& f = frames_.back();
+            if (f.Left == 0 || f.Position < 0 || f.Position >= f.Node->Branches.size())
+            {
+                frames_.pop_back();
+                if (frames_.size() == 0)
+                    break;
+                return Event::Leave;
+            }
+            const auto& step = program_->Steps[frames_.size() - 1];
+            const sp<BranchBase>& child = f.Node->Branches[f.Position];
+            f.Position += f.Stride;
+            f.Left--;
+            if (!step.Accepts(child))
+                continue;
+            if (frames_.size() == program_->Steps.size())
+            {
+                Current = child;
+                return Event::Match;
+            }
+            if (is_branch(child))
+            {
+                Push(as_branch(child));
+                return Event::Enter;
+            }
         }
-        catch (ExecutionEngineException* exception)
+        Current.reset();
+        return Event::End;
+    }
+
+private:
+    struct Frame
+    {
+        sp<Branch> Node;
+        int Position;
+        int Stride;
+        int Left;
+    };
+
+    sp<const PathProgram> program_;
+    std::vector<Frame> frames_{};
+
+    void Push(sp<Branch> node)
+    {
+        const auto& step = program_->Steps[frames_.size()];
+        Frame f{ node, 0, step.Index ? 1 : step.Pick.Step, 0 };
+        f.Left = step.Resolve(node->Branches.size(), f.Position);
+        frames_.push_back(f);
+    }
+};
+#pragma endregion
+
+#pragma region Parallel
+class Parallel
+{
+public:
+    static inline size_t MinChunk = 1 << 14;
+    static inline size_t MorselSize = 1 << 12;
+    // Worker threads, 0 uses every hardware thread
+    static inline size_t Threads = 0;
+
+    static size_t Concurrency() noexcept
+    {
+        return Threads > 0 ? Threads : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Runs body(task) for every task in [0, count) spread over the hardware threads, rethrows the first failure
+    template<typename Body>
+    static void Tasks(size_t count, Body body)
+    {
+        size_t workers = std::min(Concurrency(), count);
+        if (workers < 2)
         {
-            if (!catch_localy)
-                throw;
-            /*(Create log)*/
+            for (size_t t = 0; t < count; t++)
+                body(t);
+            return;
+        }
+        std::vector<std::exception_ptr> errors(workers);
+        std::vector<std::thread> threads;
+        auto run = [&](size_t w)
             {
-                std::stringstream str;
-                str << exception->what() << "\nCaused during invoking:" << com;
-                if (log)
-                    Log.push(str.str());
-            }
-            if (exception->ErrorLevel() > ApprovedLevel)
-                throw;
+                try
+                {
+                    for (size_t t = w; t < count; t += workers)
+                        body(t);
+                }
+                catch (...)
+                {
+                    errors[w] = std::current_exception();
+                }
+            };
+        for (size_t w = 1; w < workers; w++)
+            threads.emplace_back(run, w);
+        run(0);
+        for (auto& t : threads)
+            t.join();
+        for (auto& e : errors)
+            if (e)
+                std::rethrow_exception(e);
+    }
+
+    // Splits [0, count) into contiguous ranges of at least MinChunk run as separate tasks
+    template<typename Body>
+    static void For(size_t count, Body body)
+    {
+        size_t chunks = std::min(Concurrency(), (count + MinChunk - 1) / MinChunk);
+        if (chunks < 2)
+        {
+            body(size_t(0), count);
+            return;
         }
+        size_t step = (count + chunks - 1) / chunks;
+        Tasks(chunks, [&](size_t c)
+            {
+                body(c * step, std::min(count, (c + 1) * step));
+            });
     }
 
-    void EvalComs(std::vector<std::string> coms)
+    // Cuts [0, count) into morsels of size items and runs body(morsel, begin, end, worker) for each of them.
+    // Every worker starts on its own contiguous share of morsels and, once it runs dry, steals the back half
+    // of the share of another worker, so uneven morsels do not leave threads idle. Workers are numbered from
+    // 0 to Workers(count, size), results kept per morsel stay in input order whichever worker ran them.
+    template<typename Body>
+    static void Morsels(size_t count, size_t size, Body body)
     {
-        for (int i = 0; i < coms.size(); i++)
+        size = std::max<size_t>(1, size);
+        size_t morsels = (count + size - 1) / size;
+        size_t workers = Workers(count, size);
+        struct Share
         {
-            try
+            std::mutex Lock;
+            size_t Next{ 0 };
+            size_t End{ 0 };
+        };
+        std::vector<Share> shares(workers);
+        for (size_t w = 0; w < workers; w++)
+        {
+            shares[w].Next = morsels * w / workers;
+            shares[w].End = morsels * (w + 1) / workers;
+        }
+        auto take = [&](size_t w, size_t& m)
             {
-                EvalCom(coms[i], false, false);
+                std::lock_guard<std::mutex> lock(shares[w].Lock);
+                if (shares[w].Next == shares[w].End)
+                    return false;
+                m = shares[w].Next++;
+                return true;
+            };
+        auto steal = [&](size_t w)
+            {
+                for (size_t k = 1; k < workers; k++)
+                {
+                    Share& victim = shares[(w + k) % workers];
+                    size_t from, to;
+                    {
+                        std::lock_guard<std::mutex> lock(victim.Lock);
+                        size_t left = victim.End - victim.Next;
+                        if (left == 0)
+                            continue;
+                        to = victim.End;
+                        from = to - (left + 1) / 2;
+                        victim.End = from;
+                    }
+                    std::lock_guard<std::mutex> lock(shares[w].Lock);
+                    shares[w].Next = from;
+                    shares[w].End = to;
+                    return true;
+                }
+                return false;
+            };
+        Tasks(workers, [&](size_t w)
+            {
+                size_t m;
+                do
+                    while (take(w, m))
+                        body(m, m * size, std::min(count, (m + 1) * size), w);
+                while (steal(w));
+            });
+    }
+
+    static size_t Workers(size_t count, size_t size) noexcept
+    {
+        size = std::max<size_t>(1, size);
+        return std::max<size_t>(1, std::min(Concurrency(), (count + size - 1) / size));
+    }
+};
+#pragma endregion
+
+#pragma region Text
+// Boyer-Moore-Horspool over bytes, single byte patterns go through memchr
+class TextSearcher
+{
+public:
+    explicit TextSearcher(std::string_view pattern) : pattern_(pattern)
+    {
+        for (auto& i : shift_)
+            i = pattern_.size();
+        for (size_t i = 0; i + 1 < pattern_.size(); i++)
+            shift_[(unsigned char)pattern_[i]] = pattern_.size() - 1 - i;
+    }
+
+    size_t Size() const noexcept
+    {
+        return pattern_.size();
+    }
+
+    size_t Find(std::string_view text, size_t from = 0) const noexcept
+    {
+        size_t m = pattern_.size();
+        if (m == 0 || from > text.size() || text.size() - from < m)
+            return std::string_view::npos;
+        if (m == 1)
+        {
+            auto hit = static_cast<const char*>(std::memchr(text.data() + from, pattern_[0], text.size() - from));
+            return hit == nullptr ? std::string_view::npos : hit - text.data();
+        }
+        char last = pattern_[m - 1];
+        for (size_t p = from; p + m <= text.size(); p += shift_[(unsigned char)text[p + m - 1]])
+            if (text[p + m - 1] == last && std::memcmp(text.data() + p, pattern_.data(), m - 1) == 0)
+                return p;
+        return std::string_view::npos;
+    }
+
+    size_t Count(std::string_view text) const noexcept
+    {
+        size_t res = 0;
+        for (size_t p = Find(text); p != std::string_view::npos; p = Find(text, p + pattern_.size()))
+            res++;
+        return res;
+    }
+
+    std::string Replace(std::string_view text, std::string_view replacement) const
+    {
+        std::string res;
+        size_t p = 0;
+        for (size_t np = Find(text); np != std::string_view::npos; np = Find(text, p))
+        {
+            res.append(text.substr(p, np - p));
+            res.append(replacement);
+            p = np + pattern_.size();
+        }
+        res.append(text.substr(p));
+        return res;
+    }
+
+private:
+    std::string pattern_;
+    size_t shift_[256];
+};
+
+// Aho-Corasick automaton with every failure transition resolved up front, bytes are mapped to the classes
+// that occur in the patterns so the table stays small for thousands of keywords
+class MultiSearcher
+{
+public:
+    std::vector<std::string> Patterns{};
+
+    explicit MultiSearcher(std::vector<std::string> patterns) : Patterns(std::move(patterns))
+    {
+        for (auto& i : classes_)
+            i = 0;
+        for (auto& p : Patterns)
+            for (unsigned char c : p)
+                if (classes_[c] == 0)
+                    classes_[c] = ++stride_;
+        stride_++;
+        AddState();
+        for (size_t i = 0; i < Patterns.size(); i++)
+        {
+            int state = 0;
+            for (unsigned char c : Patterns[i])
+            {
+                int next = table_[state * stride_ + classes_[c]];
+                if (next == 0)
+                {
+                    next = AddState();
+                    table_[state * stride_ + classes_[c]] = next;
+                }
+                state = next;
             }
-            catch (ExecutionEngineException* exception)
+            outputs_[state].push_back((int)i);
+        }
+        // Breadth first so the failure state of every node is final before its children are visited
+        std::vector<int> fail(outputs_.size()), queue;
+        for (int c = 0; c < stride_; c++)
+            if (table_[c] != 0)
+                queue.push_back(table_[c]);
+        for (size_t q = 0; q < queue.size(); q++)
+        {
+            int state = queue[q];
+            links_[state] = outputs_[fail[state]].size() > 0 ? fail[state] : links_[fail[state]];
+            for (int c = 0; c < stride_; c++)
             {
-                /*Create log*/
+                int& next = table_[state * stride_ + c];
+                if (next == 0)
+                    next = table_[fail[state] * stride_ + c];
+                else
                 {
-                    std::stringstream str;
-                    str << exception->what() << "\nCaused during invoking:" << coms[i];
-                    str << "\nCom trace:";
-                    for (int j = 0; j < i + 1; j++)
-                        str << "\t" << coms[i] << "\n";
-                    Log.push(str.str());
+                    fail[next] = table_[fail[state] * stride_ + c];
+                    queue.push_back(next);
                 }
-                if (exception->ErrorLevel() > ApprovedLevel)
-                    throw;
             }
         }
     }
 
-    void PrintData(std::ostream& out)
+    // Calls hit(pattern) for every occurrence of every pattern
+    template<typename Hit>
+    void Scan(std::string_view text, Hit hit) const
     {
-        BranchStream str{ out };
-        std::stack<sp<BranchBase>> tmp;
-        while (!Data.empty())
+        int state = 0;
+        for (unsigned char c : text)
         {
-            tmp.push(Data.top());
-            str << tmp.top();
-            Data.pop();
+            state = table_[state * stride_ + classes_[c]];
+            for (int s = outputs_[state].size() > 0 ? state : links_[state]; s != 0; s = links_[s])
+                for (int p : outputs_[s])
+                    hit(p);
         }
-        while (!tmp.empty())
+    }
+
+private:
+    int classes_[256];
+    int stride_{ 0 };
+    std::vector<int> table_{};
+    std::vector<std::vector<int>> outputs_{};
+    std::vector<int> links_{};
+
+    int AddState()
+    {
+        table_.resize(table_.size() + stride_);
+        outputs_.emplace_back();
+        links_.push_back(0);
+        return (int)outputs_.size() - 1;
+    }
+};
+
+// UTF-8 text handled by code points. ASCII runs are skipped in bulk so pure ASCII pays one scan, other
+// sequences are validated (no overlongs, surrogates or code points past U+10FFFF) before their boundaries are used
+struct Utf8
+{
+    // Index of the first non ASCII byte at or after from
+    static size_t AsciiPrefix(std::string_view text, size_t from = 0) noexcept
+    {
+        const char* data = text.data();
+        size_t i = from;
+#ifdef EVALCORE_SSE2
+        for (; i + 64 <= text.size(); i += 64)
         {
-            Data.push(tmp.top());
-            tmp.pop();
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 32));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 48));
+            if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0)
+                break;
+        }
+        for (; i + 16 <= text.size(); i += 16)
+            if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))) != 0)
+                break;
+#else
+        for (; i + 8 <= text.size(); i += 8)
+        {
+            unsigned long long word;
+            std::memcpy(&word, data + i, 8);
+            if ((word & 0x8080808080808080ull) != 0)
+                break;
+        }
+#endif
+        while (i < text.size() && (unsigned char)data[i] < 0x80)
+            i++;
+        return i;
+    }
+
+    static bool IsAscii(std::string_view text) noexcept
+    {
+        return AsciiPrefix(text) == text.size();
+    }
+
+    // Bytes in the sequence starting at i, 0 when it is malformed
+    static size_t SequenceSize(std::string_view text, size_t i) noexcept
+    {
+        unsigned char b = text[i];
+        if (b < 0x80)
+            return 1;
+        size_t size;
+        unsigned char low = 0x80, high = 0xBF;
+        if (b >= 0xC2 && b <= 0xDF)
+            size = 2;
+        else if (b >= 0xE0 && b <= 0xEF)
+        {
+            size = 3;
+            low = b == 0xE0 ? 0xA0 : 0x80;
+            high = b == 0xED ? 0x9F : 0xBF;
+        }
+        else if (b >= 0xF0 && b <= 0xF4)
+        {
+            size = 4;
+            low = b == 0xF0 ? 0x90 : 0x80;
+            high = b == 0xF4 ? 0x8F : 0xBF;
+        }
+        else
+            return 0;
+        if (i + size > text.size())
+            return 0;
+        unsigned char second = text[i + 1];
+        if (second < low || second > high)
+            return 0;
+        for (size_t k = 2; k < size; k++)
+            if (((unsigned char)text[i + k] & 0xC0) != 0x80)
+                return 0;
+        return size;
+    }
+
+    // Calls f(offset, size) for every code point, ASCII runs are reported byte by byte without decoding
+    template<typename Each>
+    static void ForEach(std::string_view text, Each f)
+    {
+        for (size_t i = 0; i < text.size();)
+        {
+            size_t ascii = AsciiPrefix(text, i);
+            for (; i < ascii; i++)
+                f(i, 1);
+            if (i == text.size())
+                break;
+            size_t size = SequenceSize(text, i);
+            if (size == 0)
+                ExecutionEngineException::ThrowWraped("Invalid UTF-8", ExecutionEngineException::Level::Critical);
+            f(i, size);
+            i += size;
+        }
+    }
+
+    static void Validate(std::string_view text)
+    {
+        for (size_t i = AsciiPrefix(text); i < text.size(); i = AsciiPrefix(text, i))
+        {
+            size_t size = SequenceSize(text, i);
+            if (size == 0)
+                ExecutionEngineException::ThrowWraped("Invalid UTF-8", ExecutionEngineException::Level::Critical);
+            i += size;
+        }
+    }
+
+    static size_t Length(std::string_view text)
+    {
+        size_t res = 0;
+        for (size_t i = 0; i < text.size();)
+        {
+            size_t ascii = AsciiPrefix(text, i);
+            res += ascii - i;
+            i = ascii;
+            if (i == text.size())
+                break;
+            size_t size = SequenceSize(text, i);
+            if (size == 0)
+                ExecutionEngineException::ThrowWraped("Invalid UTF-8", ExecutionEngineException::Level::Critical);
+            res++;
+            i += size;
+        }
+        return res;
+    }
+
+    static std::string Reverse(std::string_view text)
+    {
+        std::string res(text.rbegin(), text.rend());
+        if (IsAscii(text))
+            return res;
+        ForEach(text, [&](size_t offset, size_t size)
+            {
+                if (size > 1)
+                    std::memcpy(&res[text.size() - offset - size], text.data() + offset, size);
+            });
+        return res;
+    }
+};
+
+// Regular expressions over bytes matched in linear time: a lazily built DFA answers whether a value matches,
+// a Pike VM finds the leftmost-first match with its groups. Supported: literals, escapes (\d \w \s and their
+// negations, \t \n \r and escaped metacharacters), '.', [classes] with ranges and negation, (groups), (?:...),
+// alternation, * + ? {n} {n,} {n,m} with lazy '?' variants, ^ and $ anchoring the whole value.
+class RegexProgram
+{
+public:
+    struct Inst
+    {
+        enum class Op : unsigned char
+        {
+            Set,
+            Split,
+            Jump,
+            Save,
+            Begin,
+            End,
+            Match,
+        };
+
+        Op Code;
+        int X{ 0 };
+        int Y{ 0 };
+    };
+
+    std::vector<Inst> Program{};
+    std::vector<std::bitset<256>> Sets{};
+    int Groups{ 1 };
+
+    explicit RegexProgram(std::string_view pattern) : pattern_(pattern)
+    {
+        int root = ParseAlternation();
+        if (pos_ != pattern_.size())
+            SyntaxError();
+        Emit(Inst::Op::Save, 0);
+        Compile(root);
+        Emit(Inst::Op::Save, 1);
+        Emit(Inst::Op::Match);
+        nodes_.clear();
+    }
+
+    // Per thread state: the DFA cache and the Pike VM lists, the program itself is shared read only
+    class Matcher
+    {
+    public:
+        explicit Matcher(const RegexProgram& program) : re_(program)
+        {
+            size_t n = program.Program.size();
+            slots_ = 2 * program.Groups;
+            for (auto* l : { &current_, &next_ })
+            {
+                l->Mark.assign(n, 0);
+                l->Caps.resize(n * slots_);
+            }
+        }
+
+        bool Test(std::string_view text)
+        {
+            if (states_.size() > 4096)
+            {
+                states_.clear();
+                ids_.clear();
+            }
+            if (states_.size() == 0)
+            {
+                restart_ = Closure({ 0 }, false);
+                Intern(Closure({ 0 }, true));
+            }
+            int state = 0;
+            for (size_t i = 0; i < text.size(); i++)
+            {
+                if (states_[state].Matching)
+                    return true;
+                if (states_[state].Next[(unsigned char)text[i]] < 0)
+                {
+                    // Patterns whose DFA would blow up fall back to the VM, which stays linear
+                    if (states_.size() > 4096)
+                    {
+                        std::vector<long long> groups;
+                        return Run(text, 0, groups);
+                    }
+                    std::vector<int> step = restart_;
+                    for (int pc : states_[state].Pcs)
+                        if (re_.Program[pc].Code == Inst::Op::Set && re_.Sets[re_.Program[pc].X][(unsigned char)text[i]])
+                            step.push_back(pc + 1);
+                    int created = Intern(Closure(step, false));
+                    states_[state].Next[(unsigned char)text[i]] = created;
+                }
+                state = states_[state].Next[(unsigned char)text[i]];
+            }
+            if (states_[state].Matching)
+                return true;
+            std::vector<int> ends;
+            for (int pc : states_[state].Pcs)
+                if (re_.Program[pc].Code == Inst::Op::End)
+                    ends.push_back(pc + 1);
+            for (int pc : Closure(ends, text.size() == 0, true))
+                if (re_.Program[pc].Code == Inst::Op::Match)
+                    return true;
+            return false;
+        }
+
+        // Leftmost-first match starting the search at from, groups holds begin/end offsets or -1; the DFA rejects
+        // values without any match before the VM runs
+        bool Search(std::string_view text, size_t from, std::vector<long long>& groups)
+        {
+            return (from > 0 || Test(text)) && Run(text, from, groups);
+        }
+
+    private:
+        struct State
+        {
+            std::vector<int> Pcs;
+            bool Matching;
+            int Next[256];
+        };
+
+        struct List
+        {
+            std::vector<int> Pcs{};
+            std::vector<unsigned> Mark{};
+            std::vector<long long> Caps{};
+            unsigned Generation{ 1 };
+
+            void Clear()
+            {
+                Pcs.clear();
+                if (++Generation == 0)
+                {
+                    std::fill(Mark.begin(), Mark.end(), 0);
+                    Generation = 1;
+                }
+            }
+        };
+
+        struct Frame
+        {
+            int Pc;
+            int Slot;
+            long long Restore;
+        };
+
+        const RegexProgram& re_;
+        size_t slots_;
+        List current_{}, next_{};
+        std::vector<long long> scratch_{};
+        std::vector<Frame> stack_{};
+        std::vector<State> states_{};
+        std::map<std::vector<int>, int> ids_{};
+        std::vector<int> restart_{};
+
+        bool Run(std::string_view text, size_t from, std::vector<long long>& groups)
+        {
+            bool matched = false;
+            current_.Clear();
+            std::vector<long long> caps(slots_, -1);
+            for (size_t pos = from;; pos++)
+            {
+                if (!matched)
+                    Add(current_, 0, caps.data(), text, pos);
+                if (matched && current_.Pcs.size() == 0)
+                    break;
+                next_.Clear();
+                for (size_t t = 0; t < current_.Pcs.size(); t++)
+                {
+                    int pc = current_.Pcs[t];
+                    const long long* tcaps = current_.Caps.data() + pc * slots_;
+                    const Inst& inst = re_.Program[pc];
+                    if (inst.Code == Inst::Op::Match)
+                    {
+                        groups.assign(tcaps, tcaps + slots_);
+                        matched = true;
+                        break;
+                    }
+                    if (pos < text.size() && re_.Sets[inst.X][(unsigned char)text[pos]])
+                        Add(next_, pc + 1, tcaps, text, pos + 1);
+                }
+                std::swap(current_, next_);
+                if (pos >= text.size())
+                    break;
+            }
+            return matched;
+        }
+
+        // Instructions reachable without consuming input: sets, matches and unresolved end assertions
+        std::vector<int> Closure(std::vector<int> stack, bool at_begin, bool at_end = false)
+        {
+            std::vector<char> seen(re_.Program.size());
+            std::vector<int> res;
+            while (stack.size() > 0)
+            {
+                int pc = stack.back();
+                stack.pop_back();
+                if (seen[pc])
+                    continue;
+                seen[pc] = 1;
+                const Inst& inst = re_.Program[pc];
+                switch (inst.Code)
+                {
+                case Inst::Op::Jump:
+                    stack.push_back(inst.X);
+                    break;
+                case Inst::Op::Split:
+                    stack.push_back(inst.Y);
+                    stack.push_back(inst.X);
+                    break;
+                case Inst::Op::Save:
+                    stack.push_back(pc + 1);
+                    break;
+                case Inst::Op::Begin:
+                    if (at_begin)
+                        stack.push_back(pc + 1);
+                    break;
+                case Inst::Op::End:
+                    if (at_end)
+                        stack.push_back(pc + 1);
+                    else
+                        res.push_back(pc);
+                    break;
+                default:
+                    res.push_back(pc);
+                    break;
+                }
+            }
+            std::sort(res.begin(), res.end());
+            return res;
+        }
+
+        int Intern(std::vector<int> pcs)
+        {
+            auto it = ids_.find(pcs);
+            if (it != ids_.end())
+                return it->second;
+            State state{ pcs, false, {} };
+            for (int pc : pcs)
+                state.Matching |= re_.Program[pc].Code == Inst::Op::Match;
+            std::fill(std::begin(state.Next), std::end(state.Next), -1);
+            states_.push_back(std::move(state));
+            ids_.emplace(std::move(pcs), (int)states_.size() - 1);
+            return (int)states_.size() - 1;
+        }
+
+        // Follows empty transitions in priority order, a thread keeps the captures of the first path reaching it
+        void Add(List& list, int start, const long long* caps, std::string_view text, size_t pos)
+        {
+            auto& scratch = scratch_;
+            auto& stack = stack_;
+            scratch.assign(caps, caps + slots_);
+            stack.push_back({ start, -1, 0 });
+            while (stack.size() > 0)
+            {
+                Frame f = stack.back();
+                stack.pop_back();
+                if (f.Slot >= 0)
+                {
+                    scratch[f.Slot] = f.Restore;
+                    continue;
+                }
+                if (list.Mark[f.Pc] == list.Generation)
+                    continue;
+                list.Mark[f.Pc] = list.Generation;
+                const Inst& inst = re_.Program[f.Pc];
+                switch (inst.Code)
+                {
+                case Inst::Op::Jump:
+                    stack.push_back({ inst.X, -1, 0 });
+                    break;
+                case Inst::Op::Split:
+                    stack.push_back({ inst.Y, -1, 0 });
+                    stack.push_back({ inst.X, -1, 0 });
+                    break;
+                case Inst::Op::Save:
+                    stack.push_back({ -1, inst.X, scratch[inst.X] });
+                    scratch[inst.X] = pos;
+                    stack.push_back({ f.Pc + 1, -1, 0 });
+                    break;
+                case Inst::Op::Begin:
+                    if (pos == 0)
+                        stack.push_back({ f.Pc + 1, -1, 0 });
+                    break;
+                case Inst::Op::End:
+                    if (pos == text.size())
+                        stack.push_back({ f.Pc + 1, -1, 0 });
+                    break;
+                default:
+                    list.Pcs.push_back(f.Pc);
+                    std::copy(scratch.begin(), scratch.end(), list.Caps.begin() + f.Pc * slots_);
+                    break;
+                }
+            }
+        }
+    };
+
+private:
+    struct Node
+    {
+        enum class Kind
+        {
+            Empty,
+            Set,
+            Concat,
+            Alternate,
+            Repeat,
+            Group,
+            Begin,
+            End,
+        };
+
+        Kind Type;
+        std::vector<int> Kids{};
+        int Set{ 0 };
+        int Min{ 0 };
+        int Max{ 0 };
+        bool Greedy{ true };
+        int Group{ -1 };
+    };
+
+    std::string_view pattern_;
+    size_t pos_{ 0 };
+    std::vector<Node> nodes_{};
+
+    static void SyntaxError()
+    {
+        ExecutionEngineException::ThrowWraped("Regex syntax error", ExecutionEngineException::Level::Critical);
+    }
+
+    int Add(Node node)
+    {
+        nodes_.push_back(std::move(node));
+        return (int)nodes_.size() - 1;
+    }
+
+    int Emit(Inst::Op code, int x = 0, int y = 0)
+    {
+        if (Program.size() > 100000)
+            ExecutionEngineException::ThrowWraped("Regex too large", ExecutionEngineException::Level::Critical);
+        Program.push_back({ code, x, y });
+        return (int)Program.size() - 1;
+    }
+
+    int AddSet(const std::bitset<256>& set)
+    {
+        Sets.push_back(set);
+        return (int)Sets.size() - 1;
+    }
+
+    bool More() const noexcept
+    {
+        return pos_ < pattern_.size();
+    }
+
+    int ParseAlternation()
+    {
+        std::vector<int> options{ ParseConcat() };
+        while (More() && pattern_[pos_] == '|')
+        {
+            pos_++;
+            options.push_back(ParseConcat());
+        }
+        if (options.size() == 1)
+            return options[0];
+        Node node{ Node::Kind::Alternate };
+        node.Kids = std::move(options);
+        return Add(std::move(node));
+    }
+
+    int ParseConcat()
+    {
+        Node node{ Node::Kind::Concat };
+        while (More() && pattern_[pos_] != '|' && pattern_[pos_] != ')')
+            node.Kids.push_back(ParseRepeat());
+        return Add(std::move(node));
+    }
+
+    bool ReadNumber(int& res)
+    {
+        size_t start = pos_;
+        res = 0;
+        while (More() && pattern_[pos_] >= '0' && pattern_[pos_] <= '9' && res < 100000)
+            res = res * 10 + (pattern_[pos_++] - '0');
+        return pos_ > start;
+    }
+
+    int ParseRepeat()
+    {
+        int atom = ParseAtom();
+        while (More())
+        {
+            int min = 0, max = -1;
+            char c = pattern_[pos_];
+            if (c == '*')
+                pos_++;
+            else if (c == '+')
+            {
+                min = 1;
+                pos_++;
+            }
+            else if (c == '?')
+            {
+                max = 1;
+                pos_++;
+            }
+            else if (c == '{')
+            {
+                size_t start = pos_++;
+                bool valid = ReadNumber(min);
+                max = min;
+                if (valid && More() && pattern_[pos_] == ',')
+                {
+                    pos_++;
+                    if (!ReadNumber(max))
+                        max = -1;
+                }
+                if (!valid || !More() || pattern_[pos_] != '}' || (max >= 0 && max < min) || min > 1000 || max > 1000)
+                {
+                    pos_ = start;
+                    break;
+                }
+                pos_++;
+            }
+            else
+                break;
+            Node node{ Node::Kind::Repeat };
+            node.Kids.push_back(atom);
+            node.Min = min;
+            node.Max = max;
+            if (More() && pattern_[pos_] == '?')
+            {
+                node.Greedy = false;
+                pos_++;
+            }
+            atom = Add(std::move(node));
+        }
+        return atom;
+    }
+
+    static std::bitset<256> ClassOf(char c)
+    {
+        std::bitset<256> res;
+        auto range = [&](int from, int to)
+            {
+                for (int i = from; i <= to; i++)
+                    res.set(i);
+            };
+        switch (c)
+        {
+        case 'd':
+        case 'D':
+            range('0', '9');
+            break;
+        case 'w':
+        case 'W':
+            range('0', '9');
+            range('a', 'z');
+            range('A', 'Z');
+            res.set('_');
+            break;
+        case 's':
+        case 'S':
+            for (char i : std::string_view(" \t\n\r\f\v"))
+                res.set((unsigned char)i);
+            break;
+        case 't':
+            res.set('\t');
+            break;
+        case 'n':
+            res.set('\n');
+            break;
+        case 'r':
+            res.set('\r');
+            break;
+        default:
+            res.set((unsigned char)c);
+            break;
+        }
+        if (c == 'D' || c == 'W' || c == 'S')
+            res.flip();
+        return res;
+    }
+
+    std::bitset<256> ParseClass()
+    {
+        std::bitset<256> res;
+        bool negate = More() && pattern_[pos_] == '^';
+        if (negate)
+            pos_++;
+        bool first = true;
+        while (More() && (first || pattern_[pos_] != ']'))
+        {
+            first = false;
+            char c = pattern_[pos_++];
+            if (c == '\\')
+            {
+                if (!More())
+                    SyntaxError();
+                auto set = ClassOf(pattern_[pos_++]);
+                if (set.count() != 1)
+                {
+                    res |= set;
+                    continue;
+                }
+                for (int i = 0; i < 256; i++)
+                    if (set[i])
+                        c = (char)i;
+            }
+            if (pos_ + 1 < pattern_.size() && pattern_[pos_] == '-' && pattern_[pos_ + 1] != ']')
+            {
+                unsigned char to = pattern_[pos_ + 1];
+                pos_ += 2;
+                if (to < (unsigned char)c)
+                    SyntaxError();
+                for (int i = (unsigned char)c; i <= to; i++)
+                    res.set(i);
+            }
+            else
+                res.set((unsigned char)c);
+        }
+        if (!More())
+            SyntaxError();
+        pos_++;
+        if (negate)
+            res.flip();
+        return res;
+    }
+
+    int ParseAtom()
+    {
+        if (!More())
+            SyntaxError();
+        char c = pattern_[pos_++];
+        Node node{ Node::Kind::Set };
+        switch (c)
+        {
+        case '(':
+        {
+            node.Type = Node::Kind::Group;
+            if (pattern_.substr(pos_, 2) == "?:")
+                pos_ += 2;
+            else
+                node.Group = Groups++;
+            node.Kids.push_back(ParseAlternation());
+            if (!More() || pattern_[pos_] != ')')
+                SyntaxError();
+            pos_++;
+            return Add(std::move(node));
+        }
+        case '[':
+            node.Set = AddSet(ParseClass());
+            return Add(std::move(node));
+        case '.':
+            node.Set = AddSet(std::bitset<256>().set());
+            return Add(std::move(node));
+        case '^':
+            return Add(Node{ Node::Kind::Begin });
+        case '$':
+            return Add(Node{ Node::Kind::End });
+        case '\\':
+            if (!More())
+                SyntaxError();
+            node.Set = AddSet(ClassOf(pattern_[pos_++]));
+            return Add(std::move(node));
+        case '*':
+        case '+':
+        case '?':
+        case ')':
+            SyntaxError();
+            break;
+        default:
+            node.Set = AddSet(ClassOf(c));
+            return Add(std::move(node));
+        }
+        return 0;
+    }
+
+    void Compile(int index)
+    {
+        const Node node = nodes_[index];
+        switch (node.Type)
+        {
+        case Node::Kind::Empty:
+            break;
+        case Node::Kind::Set:
+            Emit(Inst::Op::Set, node.Set);
+            break;
+        case Node::Kind::Begin:
+            Emit(Inst::Op::Begin);
+            break;
+        case Node::Kind::End:
+            Emit(Inst::Op::End);
+            break;
+        case Node::Kind::Concat:
+            for (int k : node.Kids)
+                Compile(k);
+            break;
+        case Node::Kind::Group:
+            if (node.Group >= 0)
+                Emit(Inst::Op::Save, 2 * node.Group);
+            Compile(node.Kids[0]);
+            if (node.Group >= 0)
+                Emit(Inst::Op::Save, 2 * node.Group + 1);
+            break;
+        case Node::Kind::Alternate:
+        {
+            std::vector<int> exits;
+            for (size_t k = 0; k < node.Kids.size(); k++)
+            {
+                int split = k + 1 < node.Kids.size() ? Emit(Inst::Op::Split) : -1;
+                if (split >= 0)
+                    Program[split].X = split + 1;
+                Compile(node.Kids[k]);
+                if (split >= 0)
+                {
+                    exits.push_back(Emit(Inst::Op::Jump));
+                    Program[split].Y = (int)Program.size();
+                }
+            }
+            for (int e : exits)
+                Program[e].X = (int)Program.size();
+            break;
+        }
+        case Node::Kind::Repeat:
+        {
+            for (int i = 0; i < node.Min; i++)
+                Compile(node.Kids[0]);
+            if (node.Max < 0)
+            {
+                int split = Emit(Inst::Op::Split);
+                Compile(node.Kids[0]);
+                Emit(Inst::Op::Jump, split);
+                Branch(split, split + 1, (int)Program.size(), node.Greedy);
+                break;
+            }
+            std::vector<int> splits;
+            for (int i = node.Min; i < node.Max; i++)
+            {
+                splits.push_back(Emit(Inst::Op::Split));
+                Compile(node.Kids[0]);
+            }
+            for (int split : splits)
+                Branch(split, split + 1, (int)Program.size(), node.Greedy);
+            break;
+        }
+        }
+    }
+
+    void Branch(int split, int body, int out, bool greedy)
+    {
+        Program[split].X = greedy ? body : out;
+        Program[split].Y = greedy ? out : body;
+    }
+};
+
+// Decimal text of numbers and exact integer arithmetic, shared by the pipelines and the numeric builtins.
+// Integral values print in fixed notation so that 1000000 does not come back as 1e+06
+struct NumberText
+{
+    static std::string Format(double x)
+    {
+        char buffer[64];
+        auto r = x == std::trunc(x) && std::abs(x) < 1e21 ? std::to_chars(buffer, buffer + sizeof(buffer), x, std::chars_format::fixed) : std::to_chars(buffer, buffer + sizeof(buffer), x);
+        return std::string(buffer, r.ptr);
+    }
+    static bool ParseReal(std::string_view s, double& out) noexcept
+    {
+        auto r = std::from_chars(s.data(), s.data() + s.size(), out);
+        return s.size() > 0 && r.ec == std::errc() && r.ptr == s.data() + s.size();
+    }
+    // Eight ASCII digits are checked and combined inside one 64 bit word, longer or signed forms fall back
+    // to from_chars; the word trick needs little endian loads
+    static bool ParseInteger(std::string_view s, long long& out) noexcept
+    {
+        const unsigned short probe = 1;
+        bool little = *reinterpret_cast<const unsigned char*>(&probe) == 1;
+        bool negative = s.size() > 0 && s[0] == '-';
+        size_t digits = s.size() - negative;
+        if (!little || digits == 0 || digits > 18)
+        {
+            auto r = std::from_chars(s.data(), s.data() + s.size(), out);
+            return s.size() > 0 && r.ec == std::errc() && r.ptr == s.data() + s.size();
+        }
+        const char* p = s.data() + negative;
+        unsigned long long res = 0;
+        for (; digits >= 8; digits -= 8, p += 8)
+        {
+            unsigned long long word;
+            std::memcpy(&word, p, 8);
+            if ((((word & 0xF0F0F0F0F0F0F0F0ull) | (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4))) != 0x3333333333333333ull)
+                return false;
+            word -= 0x3030303030303030ull;
+            word = word * 10 + (word >> 8);
+            word = (((word & 0x000000FF000000FFull) * 0x000F424000000064ull) + (((word >> 16) & 0x000000FF000000FFull) * 0x0000271000000001ull)) >> 32;
+            res = res * 100000000 + word;
+        }
+        for (; digits > 0; digits--, p++)
+        {
+            unsigned d = (unsigned char)*p - '0';
+            if (d > 9)
+                return false;
+            res = res * 10 + d;
+        }
+        out = negative ? -(long long)res : (long long)res;
+        return true;
+    }
+    // Integer arithmetic that leaves out untouched and returns false when the exact result does not fit
+    static bool AddExact(long long a, long long b, long long& out) noexcept
+    {
+        long long r = (long long)((unsigned long long)a + (unsigned long long)b);
+        if (((a ^ r) & (b ^ r)) < 0)
+            return false;
+        out = r;
+        return true;
+    }
+    static bool SubtractExact(long long a, long long b, long long& out) noexcept
+    {
+        long long r = (long long)((unsigned long long)a - (unsigned long long)b);
+        if (((a ^ b) & (a ^ r)) < 0)
+            return false;
+        out = r;
+        return true;
+    }
+    static bool MultiplyExact(long long a, long long b, long long& out) noexcept
+    {
+        const long long min = std::numeric_limits<long long>::min();
+        long long r = (long long)((unsigned long long)a * (unsigned long long)b);
+        if ((a == -1 && b == min) || (b == -1 && a == min) || (b != 0 && r / b != a))
+            return false;
+        out = r;
+        return true;
+    }
+    static bool DivideExact(long long a, long long b, long long& out) noexcept
+    {
+        if (b == 0 || (a == std::numeric_limits<long long>::min() && b == -1) || a % b != 0)
+            return false;
+        out = a / b;
+        return true;
+    }
+
+    // Signed 128 bit sum of integers as a high word over a wrapping low word, no count of rows overflows it
+    struct WideSum
+    {
+        long long High{ 0 };
+        unsigned long long Low{ 0 };
+
+        void Add(long long x) noexcept
+        {
+            Low += (unsigned long long)x;
+            High += (Low < (unsigned long long)x) - (x < 0);
+        }
+        void Add(const WideSum& other) noexcept
+        {
+            Low += other.Low;
+            High += other.High + (Low < other.Low);
+        }
+        // x times n, the product is built from 32 bit halves of the magnitude
+        void Add(long long x, unsigned long long n) noexcept
+        {
+            unsigned long long m = x < 0 ? 0 - (unsigned long long)x : (unsigned long long)x;
+            unsigned long long lo = (m & 0xFFFFFFFFull) * (n & 0xFFFFFFFFull);
+            unsigned long long mid1 = (m >> 32) * (n & 0xFFFFFFFFull), mid2 = (m & 0xFFFFFFFFull) * (n >> 32);
+            unsigned long long hi = (m >> 32) * (n >> 32);
+            unsigned long long mid = (lo >> 32) + (mid1 & 0xFFFFFFFFull) + (mid2 & 0xFFFFFFFFull);
+            WideSum product;
+            product.Low = (mid << 32) | (lo & 0xFFFFFFFFull);
+            product.High = (long long)(hi + (mid1 >> 32) + (mid2 >> 32) + (mid >> 32));
+            Add(x < 0 ? product.Negated() : product);
+        }
+        WideSum Negated() const noexcept
+        {
+            WideSum res;
+            res.Low = 0 - Low;
+            res.High = (long long)(~(unsigned long long)High + (Low == 0));
+            return res;
+        }
+        WideSum operator-(const WideSum& other) const noexcept
+        {
+            WideSum res = *this;
+            res.Add(other.Negated());
+            return res;
+        }
+        // The sum when it fits a long long
+        bool Fits(long long& out) const noexcept
+        {
+            if (High != ((Low >> 63) != 0 ? -1 : 0))
+                return false;
+            out = (long long)Low;
+            return true;
+        }
+        // Rounded once: the magnitude is shifted into 64 bits keeping every dropped bit in the lowest one, which
+        // leaves the conversion to double as the only rounding
+        double Real() const noexcept
+        {
+            bool negative = High < 0;
+            WideSum m = negative ? Negated() : *this;
+            unsigned long long top = (unsigned long long)m.High, low = m.Low;
+            int shift = 0;
+            for (; top != 0; shift++, top >>= 1)
+                low = (low >> 1) | (top << 63) | (low & 1);
+            double res = std::ldexp((double)low, shift);
+            return negative ? -res : res;
+        }
+        // Exact integer text when it fits, a double otherwise
+        std::string Text() const
+        {
+            long long exact;
+            return Fits(exact) ? std::to_string(exact) : Format(Real());
+        }
+    };
+};
+#pragma endregion
+
+#pragma region Pipeline
+// Fused pipeline syntax, stages are separated by spaces and applied to every row of a branch in one pass:
+//   ]n              child n of the row, negative counts from the end
+//   =X !=X          keep values equal (not equal) to X, numerically once the values are computed
+//   <X <=X >X >=X   keep values whose number compares with X
+//   ~R              keep values matching the regex R
+//   +X -X *X /X     arithmetic on numbers
+//   l               byte length
+//   # + < > /       final aggregate: count, sum, min, max or mean
+// Rows move through the stages in batches of BatchSize, no branch is built until the result. Filters leave the
+// rows as they are, only arithmetic and l replace them with computed numbers, and kept rows that were not computed
+// are shared with the input: "]2 >=10 *2 +" sums twice the third fields that are at least 10. While every input and
+// operand is an integer the numbers stay exact 64 bit integers, falling back to doubles on overflow.
+class PipelineProgram
+{
+public:
+    struct Stage
+    {
+        enum class Op : unsigned char
+        {
+            Child,
+            Equal,
+            NotEqual,
+            Less,
+            LessEqual,
+            Greater,
+            GreaterEqual,
+            Match,
+            Add,
+            Subtract,
+            Multiply,
+            Divide,
+            Length,
+        };
+
+        Op Code;
+        int Index{ 0 };
+        std::string Text{};
+        double Number{ 0 };
+        long long Integer{ 0 };
+        bool Numeric{ false };
+        bool Integral{ false };
+        sp<const RegexProgram> Regex{};
+    };
+
+    enum class Total : unsigned char
+    {
+        None,
+        Count,
+        Sum,
+        Min,
+        Max,
+        Mean,
+    };
+
+    // Aggregate of a range of rows, the totals of neighbouring ranges combine with Merge. While every row is an
+    // integer the minimum and maximum are exact, and so is the sum until it overflows
+    struct Totals
+    {
+        size_t Count{ 0 };
+        double Sum{ 0 };
+        double Carry{ 0 };
+        double Min{ std::numeric_limits<double>::infinity() };
+        double Max{ -std::numeric_limits<double>::infinity() };
+        bool Integral{ true };
+        bool Overflow{ false };
+        long long Exact{ 0 };
+        long long Low{ std::numeric_limits<long long>::max() };
+        long long High{ std::numeric_limits<long long>::min() };
+
+        void Add(double x) noexcept
+        {
+            Integral = false;
+            Accumulate(x);
+            Min = std::min(Min, x);
+            Max = std::max(Max, x);
+        }
+        void Add(long long x) noexcept
+        {
+            if (!Overflow && !NumberText::AddExact(Exact, x, Exact))
+                Overflow = true;
+            Low = std::min(Low, x);
+            High = std::max(High, x);
+            Accumulate((double)x);
+            Min = std::min(Min, (double)x);
+            Max = std::max(Max, (double)x);
+        }
+        void Merge(const Totals& other) noexcept
+        {
+            Count += other.Count;
+            Integral = Integral && other.Integral;
+            if (other.Overflow || (!Overflow && !NumberText::AddExact(Exact, other.Exact, Exact)))
+                Overflow = true;
+            Low = std::min(Low, other.Low);
+            High = std::max(High, other.High);
+            Accumulate(other.Sum);
+            Carry += other.Carry;
+            Min = std::min(Min, other.Min);
+            Max = std::max(Max, other.Max);
+        }
+        // Compensated sum, the error does not grow with the number of rows
+        void Accumulate(double x) noexcept
+        {
+            double t = Sum + x;
+            Carry += std::abs(Sum) >= std::abs(x) ? (Sum - t) + x : (x - t) + Sum;
+            Sum = t;
+        }
+        std::string Result(Total kind) const
+        {
+            if ((kind == Total::Min || kind == Total::Max || kind == Total::Mean) && Count == 0)
+                ExecutionEngineException::ThrowWraped("Empty column", ExecutionEngineException::Level::Critical);
+            switch (kind)
+            {
+            case Total::Count:
+                return std::to_string(Count);
+            case Total::Min:
+                return Integral ? std::to_string(Low) : NumberText::Format(Min);
+            case Total::Max:
+                return Integral ? std::to_string(High) : NumberText::Format(Max);
+            case Total::Mean:
+                return NumberText::Format(Integral && !Overflow ? (double)Exact / Count : (Sum + Carry) / Count);
+            default:
+                return Integral && !Overflow ? std::to_string(Exact) : NumberText::Format(Sum + Carry);
+            }
+        }
+    };
+
+    static inline size_t BatchSize = 1024;
+
+    std::vector<Stage> Stages{};
+    Total Final{ Total::None };
+
+    static sp<const PipelineProgram> Compile(std::string_view text)
+    {
+        auto res = std::make_shared<PipelineProgram>();
+        for (size_t p = 0; p < text.size();)
+        {
+            if (text[p] == ' ')
+            {
+                p++;
+                continue;
+            }
+            size_t e = std::min(text.find(' ', p), text.size());
+            if (res->Final != Total::None)
+                SyntaxError();
+            res->CompileStage(text.substr(p, e - p));
+            p = e;
+        }
+        return res;
+    }
+
+    // Per thread batch buffers and regex matchers, the program itself is shared read only
+    class Cursor
+    {
+    public:
+        explicit Cursor(const PipelineProgram& program) : program_(program)
+        {
+            for (auto& stage : program.Stages)
+                if (stage.Code == Stage::Op::Match)
+                    matchers_.emplace_back(*stage.Regex);
+            nodes_.resize(BatchSize);
+            texts_.resize(BatchSize);
+            numbers_.resize(BatchSize);
+            integers_.resize(BatchSize);
+        }
+
+        // Rows [begin, end) of input, the rows left are appended to out or, for an aggregate, added to totals
+        void Run(const Branch& input, size_t begin, size_t end, Branch* out, Totals* totals)
+        {
+            for (size_t first = begin; first < end; first += BatchSize)
+            {
+                size_t n = std::min(BatchSize, end - first);
+                for (size_t i = 0; i < n; i++)
+                    nodes_[i] = &input.Branches[first + i];
+                Batch(n, out, totals);
+            }
+        }
+
+    private:
+        enum class Form
+        {
+            Node,
+            Text,
+            Number,
+        };
+
+        const PipelineProgram& program_;
+        std::deque<RegexProgram::Matcher> matchers_{};
+        std::vector<const sp<BranchBase>*> nodes_{};
+        std::vector<std::string_view> texts_{};
+        std::vector<double> numbers_{};
+        std::vector<long long> integers_{};
+        Form form_{ Form::Node };
+        // numbers_ hold the rows parsed, in any form
+        bool parsed_{ false };
+        // integers_ hold the same numbers exactly, every row of the batch being an integer
+        bool integral_{ false };
+        size_t size_{ 0 };
+
+        void Batch(size_t n, Branch* out, Totals* totals)
+        {
+            form_ = Form::Node;
+            parsed_ = false;
+            size_ = n;
+            size_t matcher = 0;
+            for (auto& stage : program_.Stages)
+            {
+                switch (stage.Code)
+                {
+                case Stage::Op::Child:
+                    Children(stage.Index);
+                    break;
+                case Stage::Op::Equal:
+                case Stage::Op::NotEqual:
+                    if (form_ == Form::Number)
+                    {
+                        if (!stage.Numeric)
+                            ExecutionEngineException::ThrowWraped("Not a number passed as a number", ExecutionEngineException::Level::Critical);
+                        Compare(stage, [&](auto a, auto b) { return (a == b) == (stage.Code == Stage::Op::Equal); });
+                    }
+                    else
+                    {
+                        MakeTexts();
+                        Keep([&](size_t i) { return (texts_[i] == stage.Text) == (stage.Code == Stage::Op::Equal); });
+                    }
+                    break;
+                case Stage::Op::Less:
+                    Compare(stage, [](auto a, auto b) { return a < b; });
+                    break;
+                case Stage::Op::LessEqual:
+                    Compare(stage, [](auto a, auto b) { return a <= b; });
+                    break;
+                case Stage::Op::Greater:
+                    Compare(stage, [](auto a, auto b) { return a > b; });
+                    break;
+                case Stage::Op::GreaterEqual:
+                    Compare(stage, [](auto a, auto b) { return a >= b; });
+                    break;
+                case Stage::Op::Match:
+                {
+                    MakeTexts();
+                    auto& m = matchers_[matcher++];
+                    Keep([&](size_t i) { return m.Test(texts_[i]); });
+                    break;
+                }
+                case Stage::Op::Add:
+                    Compute(stage, NumberText::AddExact, [](double a, double b) { return a + b; });
+                    break;
+                case Stage::Op::Subtract:
+                    Compute(stage, NumberText::SubtractExact, [](double a, double b) { return a - b; });
+                    break;
+                case Stage::Op::Multiply:
+                    Compute(stage, NumberText::MultiplyExact, [](double a, double b) { return a * b; });
+                    break;
+                case Stage::Op::Divide:
+                    Compute(stage, NumberText::DivideExact, [](double a, double b) { return a / b; });
+                    break;
+                case Stage::Op::Length:
+                    MakeTexts();
+                    for (size_t i = 0; i < size_; i++)
+                    {
+                        integers_[i] = (long long)texts_[i].size();
+                        numbers_[i] = (double)integers_[i];
+                    }
+                    form_ = Form::Number;
+                    parsed_ = true;
+                    integral_ = true;
+                    break;
+                }
+            }
+            if (program_.Final == Total::Count)
+                totals->Count += size_;
+            else if (program_.Final != Total::None)
+            {
+                Parse();
+                totals->Count += size_;
+                if (integral_)
+                    for (size_t i = 0; i < size_; i++)
+                        totals->Add(integers_[i]);
+                else
+                    for (size_t i = 0; i < size_; i++)
+                        totals->Add(numbers_[i]);
+            }
+            else if (form_ == Form::Number)
+                for (size_t i = 0; i < size_; i++)
+                    out->Branches.push_back(Value::Make(integral_ ? std::to_string(integers_[i]) : NumberText::Format(numbers_[i])));
+            else
+                for (size_t i = 0; i < size_; i++)
+                    out->Branches.push_back(*nodes_[i]);
+        }
+
+        void Children(int index)
+        {
+            if (form_ == Form::Number)
+                ExecutionEngineException::ThrowWraped("Number as branch argument", ExecutionEngineException::Level::Critical);
+            for (size_t i = 0; i < size_; i++)
+            {
+                auto br = dynamic_cast<const Branch*>(nodes_[i]->get());
+                if (br == nullptr)
+                    ExecutionEngineException::ThrowWraped("Value as branch argument", ExecutionEngineException::Level::Critical);
+                int size = (int)br->Branches.size();
+                int at = index < 0 ? index + size : index;
+                if (at < 0 || at >= size)
+                    ExecutionEngineException::ThrowWraped("Index out of range", ExecutionEngineException::Level::Critical);
+                nodes_[i] = &br->Branches[at];
+            }
+            form_ = Form::Node;
+            parsed_ = false;
+        }
+        void MakeTexts()
+        {
+            if (form_ == Form::Number)
+                ExecutionEngineException::ThrowWraped("Number as text argument", ExecutionEngineException::Level::Critical);
+            if (form_ == Form::Text)
+                return;
+            for (size_t i = 0; i < size_; i++)
+            {
+                auto v = dynamic_cast<const Value*>(nodes_[i]->get());
+                if (v == nullptr)
+                    ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+                texts_[i] = v->View();
+            }
+            form_ = Form::Text;
+        }
+        // Numbers of the rows for a filter, the rows themselves are kept
+        void Parse()
+        {
+            if (parsed_)
+                return;
+            MakeTexts();
+            integral_ = true;
+            for (size_t i = 0; i < size_; i++)
+            {
+                if (integral_ && NumberText::ParseInteger(texts_[i], integers_[i]))
+                {
+                    numbers_[i] = (double)integers_[i];
+                    continue;
+                }
+                integral_ = false;
+                if (!NumberText::ParseReal(texts_[i], numbers_[i]))
+                    ExecutionEngineException::ThrowWraped("Not a number passed as a number", ExecutionEngineException::Level::Critical);
+            }
+            parsed_ = true;
+        }
+        // Filter on the numbers of the rows, exact when both sides are integers
+        template<typename Test>
+        void Compare(const Stage& stage, Test test)
+        {
+            Parse();
+            if (integral_ && stage.Integral)
+                Keep([&](size_t i) { return test(integers_[i], stage.Integer); });
+            else
+                Keep([&](size_t i) { return test(numbers_[i], stage.Number); });
+        }
+        // Arithmetic replacing the rows with numbers, exact on integer rows and operands. A result that does not
+        // fit moves the whole batch to doubles
+        template<typename Real>
+        void Compute(const Stage& stage, bool (*exact)(long long, long long, long long&), Real real)
+        {
+            Parse();
+            form_ = Form::Number;
+            size_t i = 0;
+            if (integral_ && stage.Integral)
+            {
+                for (; i < size_ && exact(integers_[i], stage.Integer, integers_[i]); i++)
+                    numbers_[i] = (double)integers_[i];
+                if (i == size_)
+                    return;
+            }
+            integral_ = false;
+            for (; i < size_; i++)
+                numbers_[i] = real(numbers_[i], stage.Number);
+        }
+        // Compacts the batch to the rows keep accepts
+        template<typename Accept>
+        void Keep(Accept keep)
+        {
+            size_t w = 0;
+            for (size_t i = 0; i < size_; i++)
+                if (keep(i))
+                {
+                    nodes_[w] = nodes_[i];
+                    texts_[w] = texts_[i];
+                    numbers_[w] = numbers_[i];
+                    integers_[w] = integers_[i];
+                    w++;
+                }
+            size_ = w;
+        }
+    };
+
+private:
+    void CompileStage(std::string_view token)
+    {
+        Stage stage{ Stage::Op::Child };
+        std::string_view operand = token.substr(1);
+        auto total = [&](Total kind)
+            {
+                Final = kind;
+            };
+        switch (token[0])
+        {
+        case ']':
+        {
+            auto r = std::from_chars(operand.data(), operand.data() + operand.size(), stage.Index);
+            if (operand.size() == 0 || r.ec != std::errc() || r.ptr != operand.data() + operand.size())
+                SyntaxError();
+            break;
+        }
+        case '#':
+            if (operand.size() != 0)
+                SyntaxError();
+            return total(Total::Count);
+        case 'l':
+            if (operand.size() != 0)
+                SyntaxError();
+            stage.Code = Stage::Op::Length;
+            break;
+        case '~':
+            if (operand.size() == 0)
+                SyntaxError();
+            stage.Code = Stage::Op::Match;
+            stage.Regex = std::make_shared<const RegexProgram>(operand);
+            break;
+        case '=':
+        case '!':
+        case '<':
+        case '>':
+        {
+            bool orEqual = operand.size() > 0 && operand[0] == '=';
+            if (token[0] == '!' && !orEqual)
+                SyntaxError();
+            if (token[0] != '=' && orEqual)
+                operand.remove_prefix(1);
+            if (operand.size() == 0 && !orEqual && (token[0] == '<' || token[0] == '>'))
+                return total(token[0] == '<' ? Total::Min : Total::Max);
+            if (operand.size() == 0)
+                SyntaxError();
+            stage.Text = std::string(operand);
+            stage.Numeric = ReadOperand(operand, stage);
+            if (token[0] == '=')
+                stage.Code = Stage::Op::Equal;
+            else if (token[0] == '!')
+                stage.Code = Stage::Op::NotEqual;
+            else if (token[0] == '<')
+                stage.Code = orEqual ? Stage::Op::LessEqual : Stage::Op::Less;
+            else
+                stage.Code = orEqual ? Stage::Op::GreaterEqual : Stage::Op::Greater;
+            if (!stage.Numeric && stage.Code != Stage::Op::Equal && stage.Code != Stage::Op::NotEqual)
+                SyntaxError();
+            break;
+        }
+        case '+':
+        case '-':
+        case '*':
+        case '/':
+            if (operand.size() == 0)
+            {
+                if (token[0] == '+')
+                    return total(Total::Sum);
+                if (token[0] == '/')
+                    return total(Total::Mean);
+                SyntaxError();
+            }
+            if (!ReadOperand(operand, stage))
+                SyntaxError();
+            stage.Code = token[0] == '+' ? Stage::Op::Add : token[0] == '-' ? Stage::Op::Subtract : token[0] == '*' ? Stage::Op::Multiply : Stage::Op::Divide;
+            break;
+        default:
+            SyntaxError();
+        }
+        Stages.push_back(std::move(stage));
+    }
+
+    static bool ReadOperand(std::string_view operand, Stage& stage) noexcept
+    {
+        stage.Integral = NumberText::ParseInteger(operand, stage.Integer);
+        if (stage.Integral)
+            stage.Number = (double)stage.Integer;
+        return stage.Integral || NumberText::ParseReal(operand, stage.Number);
+    }
+
+    static void SyntaxError()
+    {
+        ExecutionEngineException::ThrowWraped("Pipeline syntax error", ExecutionEngineException::Level::Critical);
+    }
+};
+#pragma endregion
+
+#pragma region Sketches
+// Approximate distinct count, p = 14 gives about 0.8% standard error in 16 KB
+class HyperLogLog
+{
+public:
+    static constexpr int Precision = 14;
+    std::vector<unsigned char> Registers = std::vector<unsigned char>(1 << Precision);
+
+    void Add(std::string_view item) noexcept
+    {
+        unsigned long long h = Mix(std::hash<std::string_view>{}(item));
+        size_t index = h >> (64 - Precision);
+        unsigned long long rest = (h << Precision) | (1ull << (Precision - 1));
+        unsigned char rank = 1;
+        while ((rest & (1ull << 63)) == 0)
+        {
+            rest <<= 1;
+            rank++;
+        }
+        Registers[index] = std::max(Registers[index], rank);
+    }
+
+    void Merge(const HyperLogLog& other) noexcept
+    {
+        for (size_t i = 0; i < Registers.size(); i++)
+            Registers[i] = std::max(Registers[i], other.Registers[i]);
+    }
+
+    double Estimate() const noexcept
+    {
+        double m = Registers.size();
+        double sum = 0;
+        size_t zeros = 0;
+        for (auto r : Registers)
+        {
+            sum += std::ldexp(1.0, -r);
+            zeros += r == 0;
+        }
+        double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+        if (e <= 2.5 * m && zeros > 0)
+            return m * std::log(m / zeros);
+        return e;
+    }
+
+    std::string Serialize() const
+    {
+        return "H" + std::string(Registers.begin(), Registers.end());
+    }
+
+    static HyperLogLog Deserialize(std::string_view payload)
+    {
+        HyperLogLog res;
+        if (payload.size() != res.Registers.size() + 1 || payload[0] != 'H')
+            ExecutionEngineException::ThrowWraped("Corrupted sketch", ExecutionEngineException::Level::Critical);
+        std::memcpy(res.Registers.data(), payload.data() + 1, res.Registers.size());
+        return res;
+    }
+
+private:
+    static unsigned long long Mix(unsigned long long h) noexcept
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+};
+
+// Merging t-digest, centroids are kept small near the tails so extreme quantiles stay accurate
+class TDigest
+{
+public:
+    struct Centroid
+    {
+        double Mean;
+        double Weight;
+    };
+
+    static constexpr double Compression = 100;
+    std::vector<Centroid> Centroids{};
+    double Min = INFINITY;
+    double Max = -INFINITY;
+
+    void Add(double x)
+    {
+        buffer_.push_back({ x, 1 });
+        Min = std::min(Min, x);
+        Max = std::max(Max, x);
+        if (buffer_.size() >= 8 * Compression)
+            Compress();
+    }
+
+    void Merge(const TDigest& other)
+    {
+        buffer_.insert(buffer_.end(), other.Centroids.begin(), other.Centroids.end());
+        buffer_.insert(buffer_.end(), other.buffer_.begin(), other.buffer_.end());
+        Min = std::min(Min, other.Min);
+        Max = std::max(Max, other.Max);
+        Compress();
+    }
+
+    void Compress()
+    {
+        if (buffer_.size() == 0)
+            return;
+        buffer_.insert(buffer_.end(), Centroids.begin(), Centroids.end());
+        std::sort(buffer_.begin(), buffer_.end(), [](const Centroid& a, const Centroid& b) { return a.Mean < b.Mean; });
+        double total = 0;
+        for (auto& c : buffer_)
+            total += c.Weight;
+        Centroids.clear();
+        Centroid current = buffer_[0];
+        double before = 0;
+        for (size_t i = 1; i < buffer_.size(); i++)
+        {
+            double proposed = current.Weight + buffer_[i].Weight;
+            if (Scale((before + proposed) / total) - Scale(before / total) <= 1)
+            {
+                current.Mean += (buffer_[i].Mean - current.Mean) * buffer_[i].Weight / proposed;
+                current.Weight = proposed;
+            }
+            else
+            {
+                before += current.Weight;
+                Centroids.push_back(current);
+                current = buffer_[i];
+            }
+        }
+        Centroids.push_back(current);
+        buffer_.clear();
+    }
+
+    double Quantile(double q) const
+    {
+        if (Centroids.size() == 0)
+            ExecutionEngineException::ThrowWraped("Quantile of empty sketch", ExecutionEngineException::Level::Critical);
+        double total = 0;
+        for (auto& c : Centroids)
+            total += c.Weight;
+        double target = std::min(std::max(q, 0.0), 1.0) * total;
+        double left = Min, left_at = 0, seen = 0;
+        for (auto& c : Centroids)
+        {
+            double center = seen + c.Weight / 2;
+            if (target < center)
+                return center == left_at ? c.Mean : left + (c.Mean - left) * (target - left_at) / (center - left_at);
+            left = c.Mean;
+            left_at = center;
+            seen += c.Weight;
+        }
+        return total == left_at ? Max : left + (Max - left) * (target - left_at) / (total - left_at);
+    }
+
+    std::string Serialize()
+    {
+        Compress();
+        std::string res = "T";
+        res.append(reinterpret_cast<const char*>(&Min), sizeof(double));
+        res.append(reinterpret_cast<const char*>(&Max), sizeof(double));
+        res.append(reinterpret_cast<const char*>(Centroids.data()), Centroids.size() * sizeof(Centroid));
+        return res;
+    }
+
+    static TDigest Deserialize(std::string_view payload)
+    {
+        TDigest res;
+        if (payload.size() < 1 + 2 * sizeof(double) || payload[0] != 'T' || (payload.size() - 1 - 2 * sizeof(double)) % sizeof(Centroid) != 0)
+            ExecutionEngineException::ThrowWraped("Corrupted sketch", ExecutionEngineException::Level::Critical);
+        std::memcpy(&res.Min, payload.data() + 1, sizeof(double));
+        std::memcpy(&res.Max, payload.data() + 1 + sizeof(double), sizeof(double));
+        res.Centroids.resize((payload.size() - 1 - 2 * sizeof(double)) / sizeof(Centroid));
+        std::memcpy(res.Centroids.data(), payload.data() + 1 + 2 * sizeof(double), res.Centroids.size() * sizeof(Centroid));
+        return res;
+    }
+
+private:
+    std::vector<Centroid> buffer_{};
+
+    static double Scale(double q) noexcept
+    {
+        return Compression / (2 * 3.14159265358979323846) * std::asin(2 * q - 1);
+    }
+};
+
+// Uniform sample of at most Capacity items out of Seen
+class Reservoir
+{
+public:
+    size_t Capacity{ 0 };
+    unsigned long long Seen{ 0 };
+    std::vector<std::string> Items{};
+
+    Reservoir(size_t capacity, unsigned long long seed = 0) : Capacity(capacity), random_(seed) {}
+
+    void Add(std::string_view item)
+    {
+        Seen++;
+        if (Items.size() < Capacity)
+            Items.emplace_back(item);
+        else
+        {
+            unsigned long long j = std::uniform_int_distribution<unsigned long long>(0, Seen - 1)(random_);
+            if (j < Capacity)
+                Items[j] = item;
+        }
+    }
+
+    // Each slot is drawn from a side with probability proportional to the population it still stands for
+    void Merge(Reservoir& other)
+    {
+        std::vector<std::string> merged;
+        unsigned long long left = Seen, right = other.Seen;
+        size_t li = Items.size(), ri = other.Items.size();
+        std::shuffle(Items.begin(), Items.end(), random_);
+        std::shuffle(other.Items.begin(), other.Items.end(), random_);
+        while (merged.size() < Capacity && (li > 0 || ri > 0))
+        {
+            bool take_left = ri == 0 || (li > 0 && std::uniform_int_distribution<unsigned long long>(0, left + right - 1)(random_) < left);
+            if (take_left)
+            {
+                merged.push_back(std::move(Items[--li]));
+                left--;
+            }
+            else
+            {
+                merged.push_back(std::move(other.Items[--ri]));
+                right--;
+            }
+        }
+        Seen += other.Seen;
+        Items = std::move(merged);
+    }
+
+    std::string Serialize() const
+    {
+        std::string res = "R";
+        unsigned long long header[2]{ Capacity, Seen };
+        res.append(reinterpret_cast<const char*>(header), sizeof(header));
+        for (auto& i : Items)
+        {
+            unsigned long long size = i.size();
+            res.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            res.append(i);
+        }
+        return res;
+    }
+
+    static Reservoir Deserialize(std::string_view payload)
+    {
+        unsigned long long header[2];
+        if (payload.size() < 1 + sizeof(header) || payload[0] != 'R')
+            ExecutionEngineException::ThrowWraped("Corrupted sketch", ExecutionEngineException::Level::Critical);
+        std::memcpy(header, payload.data() + 1, sizeof(header));
+        Reservoir res(header[0], header[1]);
+        res.Seen = header[1];
+        for (size_t p = 1 + sizeof(header); p < payload.size();)
+        {
+            unsigned long long size;
+            if (payload.size() - p < sizeof(size))
+                ExecutionEngineException::ThrowWraped("Corrupted sketch", ExecutionEngineException::Level::Critical);
+            std::memcpy(&size, payload.data() + p, sizeof(size));
+            p += sizeof(size);
+            if (payload.size() - p < size)
+                ExecutionEngineException::ThrowWraped("Corrupted sketch", ExecutionEngineException::Level::Critical);
+            res.Items.emplace_back(payload.substr(p, size));
+            p += size;
+        }
+        return res;
+    }
+
+private:
+    std::mt19937_64 random_;
+};
+#pragma endregion
+
+class Evaluator
+{
+public:
+    using Function = std::function<void(Evaluator* eval)>;
+    struct FuncDef
+    {
+        Function Func;
+        std::string Name;
+
+        FuncDef(Function f, std::string n) : Func(f), Name(n) {}
+
+        bool operator<(const FuncDef& other) const noexcept
+        {
+            return Name < other.Name;
+        }
+        bool operator==(const FuncDef& other) const noexcept
+        {
+            return Name == other.Name;
+        }
+    };
+
+    std::set<FuncDef> Functions;
+    DataStack Data;
+    std::stack<std::string> Log;
+    std::map<std::string, sp<const PathProgram>, std::less<>> Selectors;
+    std::map<std::string, sp<const TextSearcher>, std::less<>> Searchers;
+    std::unordered_multimap<size_t, sp<const MultiSearcher>> MultiSearchers;
+    std::map<std::string, sp<const RegexProgram>, std::less<>> Regexes;
+    std::map<std::string, sp<const PipelineProgram>, std::less<>> Pipelines;
+    // Entries a compiled pattern cache holds before it is emptied, patterns can come from data
+    static inline size_t CacheLimit = 1024;
+
+    ExecutionEngineException::Level ApprovedLevel;
+
+    Evaluator() {}
+
+    void LoadDefault()
+    {
+        // ^ - pack operation
+        // t - top only operation
+        // c - count argument
+        // d - depth argument
+        // i - index argument
+        // g - grouped operation
+        // _ - reverse operation
+        // | - generative operation
+        // M - math operations
+        // Y - tree operations
+        // S - statistics operations
+        // ? - logical operations
+        // # - remove operation
+        // $ - row operation
+        // = - assign operation
+        // ~ - swap operation
+        // : - slice operation
+        // * - batch operation (index branch argument)
+        // z - zip operation (Y), compressed integer column (M)
+        // m - mask result
+        // x - regex operation
+        // @ - compaction operation
+        // l - length operation
+        // 8 - UTF-8 aware operation (code points instead of bytes)
+        // p - parse into a typed column
+        // e - dictionary encoded column
+        // <> - range operation (positions of values within inclusive bounds)
+        // > - fused pipeline (stage spec on top)
+        // / - path selector operation
+        // u - unique operation
+        // tk - top k operation
+        // n - nth element operation
+        // lb - lower bound operation
+        // bs - binary search operation
+        // % - sketch operation (u approximate distinct, q quantiles, r reservoir sample)
+        // w - rolling window operation
+        Functions.insert({ PackTop, "^t" });
+        Functions.insert({ PackTopSameLevel, "^" });
+        Functions.insert({ UnpackTop, "^_t" });
+        Functions.insert({ PackTopX, "^tc" });
+
+        Functions.insert({ EmptyBranch, "|Eb" });
+        Functions.insert({ EmptyElement , "|Ev" });
+        Functions.insert({ CopyFromIndex, "|i" });
+        Functions.insert({ ExtractColumnPack, "|id" }) ;
+        Functions.insert({ CopyFromIndex, "|[" });
+        Functions.insert({ ExtractColumnPack, "|]" }) ;
+        Functions.insert({ ExtractGroupedColumnPack, "|]g" }) ;
+        Functions.insert({ SelectPath, "|/" });
+        Functions.insert({ SelectGroupedPath, "|/g" });
+        Functions.insert({ MatchTop, "Y?" });
+        Functions.insert({ Unique, "Yu" });
+        Functions.insert({ Union, "Y+" });
+        Functions.insert({ Intersect, "Y&" });
+        Functions.insert({ Difference, "Y-" });
+
+        Functions.insert({ TopK, "Stk" });
+        Functions.insert({ NthElement, "Sn" });
+        Functions.insert({ LowerBound, "Slb" });
+        Functions.insert({ BinarySearch, "Sbs" });
+        Functions.insert({ SketchDistinct, "S%u" });
+        Functions.insert({ SketchQuantiles, "S%q" });
+        Functions.insert({ SketchSample, "S%r" });
+        Functions.insert({ SketchMerge, "S%+" });
+        Functions.insert({ SketchEstimate, "S%" });
+        Functions.insert({ RollingSum, "Sw+" });
+        Functions.insert({ RollingMean, "Sw/" });
+        Functions.insert({ RollingMin, "Sw<" });
+        Functions.insert({ RollingMax, "Sw>" });
+        Functions.insert({ ParseColumn, "Mp" });
+        Functions.insert({ FormatColumn, "M_p" });
+        Functions.insert({ CompressColumn, "Mz" });
+        Functions.insert({ DecompressColumn, "M_z" });
+        Functions.insert({ ColumnSum, "M+" });
+        Functions.insert({ ColumnMin, "M<" });
+        Functions.insert({ ColumnMax, "M>" });
+        Functions.insert({ ColumnRange, "M<>" });
+        Functions.insert({ Slice, "|:" });
+        Functions.insert({ SliceStep, "|::" });
+
+        Functions.insert({ RunPipeline, "|>" });
+
+        Functions.insert({ Copy, "|" });
+        Functions.insert({ Duplicate, "|c" });
+
+        Functions.insert({ [](Evaluator* eval) { eval->Data.pop(); }, "#" });
+        Functions.insert({ DeepRemove, "#d" });
+
+        Functions.insert({ Undot, "$" });
+        Functions.insert({ ConcatRow, "$^" });
+        Functions.insert({ SplitRow, "$_" });
+
+        Functions.insert({ FindRow, "$f" });
+        Functions.insert({ CountRow, "$n" });
+        Functions.insert({ ReplaceRow, "$r" });
+        Functions.insert({ MatchPatterns, "$*" });
+        Functions.insert({ MatchPatternsMask, "$*m" });
+        Functions.insert({ RegexTest, "$x" });
+        Functions.insert({ RegexExtract, "$x[" });
+        Functions.insert({ RegexMatchAll, "$x*" });
+        Functions.insert({ RegexSplit, "$x_" });
+
+        Functions.insert({ Reverse, "_" });
+        Functions.insert({ ReverseUtf8, "_8" });
+        Functions.insert({ SplitUtf8, "$_8" });
+        Functions.insert({ LengthUtf8, "$l8" });
+
+        Functions.insert({ SetChild, "Y=i" });
+        Functions.insert({ AppendChild, "Y^" });
+        Functions.insert({ InsertChild, "Y^i" });
+        Functions.insert({ RemoveChild, "Y#i" });
+        Functions.insert({ SwapChildren, "Y~" });
+        Functions.insert({ CompactTop, "Y@" });
+        Functions.insert({ EncodeDictionary, "Ye" });
+        Functions.insert({ DecodeDictionary, "Y_e" });
+        Functions.insert({ GroupDictionary, "Yeg" });
+        Functions.insert({ EqualDictionary, "Ye=" });
+        Functions.insert({ Gather, "|[*" });
+        Functions.insert({ Scatter, "Y=*" });
+        Functions.insert({ ZipColumns, "Yz" });
+        Functions.insert({ ZipTopX, "Yzc" });
+        Functions.insert({ Unzip, "Y_z" });
+    }
+
+    void EvalCom(std::string com, bool log = true, bool catch_localy = true)
+    {
+        try
+        {
+            if (com.size() < 1)
+                return;
+            auto it = Functions.find({ nullptr,com });
+            if (it == Functions.end())
+                Data.push(Slot::Text(com));
+            else
+                it->Func(this);
+        }
+        catch (ExecutionEngineException* exception)
+        {
+            if (!catch_localy)
+                throw;
+            /*(Create log)*/
+            {
+                std::stringstream str;
+                str << exception->what() << "\nCaused during invoking:" << com;
+                if (log)
+                    Log.push(str.str());
+            }
+            if (exception->ErrorLevel() > ApprovedLevel)
+                throw;
+        }
+    }
+
+    void EvalComs(std::vector<std::string> coms)
+    {
+        for (int i = 0; i < coms.size(); i++)
+        {
+            try
+            {
+                EvalCom(coms[i], false, false);
+            }
+            catch (ExecutionEngineException* exception)
+            {
+                /*Create log*/
+                {
+                    std::stringstream str;
+                    str << exception->what() << "\nCaused during invoking:" << coms[i];
+                    str << "\nCom trace:";
+                    for (int j = 0; j < i + 1; j++)
+                        str << "\t" << coms[i] << "\n";
+                    Log.push(str.str());
+                }
+                if (exception->ErrorLevel() > ApprovedLevel)
+                    throw;
+            }
+        }
+    }
+
+    sp<const PathProgram> Selector(std::string_view text)
+    {
+        auto it = Selectors.find(text);
+        if (it != Selectors.end())
+            return it->second;
+        auto program = PathProgram::Compile(text);
+        Remember(Selectors, std::string(text), program);
+        return program;
+    }
+
+    sp<const TextSearcher> Searcher(std::string_view pattern)
+    {
+        auto it = Searchers.find(pattern);
+        if (it != Searchers.end())
+            return it->second;
+        auto searcher = std::make_shared<const TextSearcher>(pattern);
+        Remember(Searchers, std::string(pattern), searcher);
+        return searcher;
+    }
+
+    sp<const RegexProgram> Regex(std::string_view pattern)
+    {
+        auto it = Regexes.find(pattern);
+        if (it != Regexes.end())
+            return it->second;
+        auto program = std::make_shared<const RegexProgram>(pattern);
+        Remember(Regexes, std::string(pattern), program);
+        return program;
+    }
+
+    sp<const PipelineProgram> Pipeline(std::string_view spec)
+    {
+        auto it = Pipelines.find(spec);
+        if (it != Pipelines.end())
+            return it->second;
+        auto program = PipelineProgram::Compile(spec);
+        Remember(Pipelines, std::string(spec), program);
+        return program;
+    }
+
+    // A full cache is emptied rather than evicted entry by entry, programs already handed out stay alive
+    template<typename Cache, typename Key, typename Program>
+    static void Remember(Cache& cache, Key key, Program program)
+    {
+        if (cache.size() >= std::max<size_t>(1, CacheLimit))
+            cache.clear();
+        cache.emplace(std::move(key), std::move(program));
+    }
+
+    // Automatons are looked up by the structural hash of the pattern branch and checked against its patterns
+    sp<const MultiSearcher> MultiSearcherOf(const Branch& patterns)
+    {
+        auto range = MultiSearchers.equal_range(patterns.Hash());
+        for (auto it = range.first; it != range.second; it++)
+        {
+            auto& known = it->second->Patterns;
+            bool same = known.size() == patterns.Branches.size();
+            for (size_t i = 0; same && i < known.size(); i++)
+            {
+                auto v = dynamic_cast<const Value*>(patterns.Branches[i].get());
+                same = v != nullptr && v->View() == known[i];
+            }
+            if (same)
+                return it->second;
+        }
+        std::vector<std::string> list;
+        for (auto& i : patterns.Branches)
+        {
+            RequireValue(i);
+            if (as_value(i)->IsEmpty())
+                ExecutionEngineException::ThrowWraped("Empty passed as pattern", ExecutionEngineException::Level::Critical);
+            list.emplace_back(as_value(i)->View());
+        }
+        auto searcher = std::make_shared<const MultiSearcher>(std::move(list));
+        Remember(MultiSearchers, patterns.Hash(), searcher);
+        return searcher;
+    }
+
+    // Runs a selector over the whole tree, grouped results mirror the branches descended into
+    static sp<Branch> Select(PathCursor& cursor, bool grouped, bool copy)
+    {
+        sp<Branch> res = std::make_shared<Branch>();
+        std::vector<Branch*> groups{ res.get() };
+        PathCursor::Event e;
+        while ((e = cursor.Next()) != PathCursor::Event::End)
+        {
+            if (e == PathCursor::Event::Match)
+                groups.back()->Branches.push_back(copy ? cursor.Current->Copy() : cursor.Current);
+            else if (!grouped)
+                continue;
+            else if (e == PathCursor::Event::Enter)
+            {
+                auto b_ = std::make_shared<Branch>();
+                groups.back()->Branches.push_back(b_);
+                groups.push_back(b_.get());
+            }
+            else
+                groups.pop_back();
+        }
+        return res;
+    }
+
+    void PrintData(std::ostream& out)
+    {
+        BranchStream str{ out };
+        std::stack<sp<BranchBase>> tmp;
+        while (!Data.empty())
+        {
+            tmp.push(Data.top());
+            str << tmp.top();
+            Data.pop();
+        }
+        while (!tmp.empty())
+        {
+            Data.push(tmp.top());
+            tmp.pop();
+        }
+    }
+
+    static void RequireValue(sp<BranchBase> br)
+    {
+        if (!is_value(br))
+            ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+    }
+
+    static void RequireBranch(sp<BranchBase> br)
+    {
+        if (!is_branch(br))
+            ExecutionEngineException::ThrowWraped("Value as branch argument", ExecutionEngineException::Level::Critical);
+    }
+
+    static void RequireInteger(sp<BranchBase> br)
+    {
+        RequireValue(br);
+        RequireIntegerText(as_value(br)->View());
+    }
+
+    static void RequireIntegerText(std::string_view text)
+    {
+        if (text.size() > 8)
+            ExecutionEngineException::ThrowWraped("Number larger than integer", ExecutionEngineException::Level::Critical);
+        if (text.size() == 0)
+            ExecutionEngineException::ThrowWraped("Passing empty as number", ExecutionEngineException::Level::Critical);
+        for (char c : text)
+            if (c < '0' || c > '9')
+                ExecutionEngineException::ThrowWraped("Not a number passed as an integer", ExecutionEngineException::Level::Critical);
+    }
+
+    void RequireTop(int sz = 1)
+    {
+        if (Data.size() < sz)
+            ExecutionEngineException::ThrowWraped("Required argument, but not passed", ExecutionEngineException::Level::Critical);
+    }
+
+    // Checked on the slot, an immediate top is not boxed
+    void RequireValueTop()
+    {
+        RequireTop();
+        if (!is_value(Data.top()))
+            ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+    }
+
+    void RequireIntegerTop()
+    {
+        RequireValueTop();
+        RequireIntegerText(Data.top().View());
+    }
+
+    void RequireBranchTop()
+    {
+        RequireTop();
+        if (!is_branch(Data.top()))
+            ExecutionEngineException::ThrowWraped("Value as branch argument", ExecutionEngineException::Level::Critical);
+    }
+
+    int PopInteger()
+    {
+        RequireIntegerTop();
+        std::string_view text = Data.top().View();
+        int res = 0;
+        std::from_chars(text.data(), text.data() + text.size(), res);
+        Data.pop();
+        return res;
+    }
+
+    // Empty value stands for an omitted bound, negative values count from the end
+    bool PopBound(int& bound)
+    {
+        RequireValueTop();
+        std::string_view text = Data.top().View();
+        if (text.size() == 0)
+        {
+            Data.pop();
+            return false;
+        }
+        std::string_view digits = text;
+        if (digits[0] == '-')
+            digits.remove_prefix(1);
+        if (digits.size() == 0 || digits.size() > 8)
+            ExecutionEngineException::ThrowWraped("Not a number passed as an integer", ExecutionEngineException::Level::Critical);
+        for (char c : digits)
+            if (c < '0' || c > '9')
+                ExecutionEngineException::ThrowWraped("Not a number passed as an integer", ExecutionEngineException::Level::Critical);
+        std::from_chars(text.data(), text.data() + text.size(), bound);
+        Data.pop();
+        return true;
+    }
+
+    // Relocates the tree depth slots below the top into contiguous depth-first storage, returns its layout
+    // before and after
+    std::pair<Fragmentation, Fragmentation> Compact(size_t depth = 0)
+    {
+        RequireTop((int)depth + 1);
+        Slot& slot = Data.Container()[Data.size() - 1 - depth];
+        if (slot.IsImmediate())
+            return {};
+        Fragmentation before = TreeCompactor::Measure(slot.Node());
+        slot = TreeCompactor::Compact(slot.Node());
+        return { before, TreeCompactor::Measure(slot.Node()) };
+    }
+
+    // Nodes may be shared between trees, so in-place operations detach the top first
+    void MakeTopUnique()
+    {
+        RequireTop();
+        if (Data.top().use_count() < 2)
+            return;
+        if (is_value(Data.top()))
+            Data.top() = Data.top()->Copy();
+        else
+            Data.top() = std::make_shared<Branch>(*as_branch(Data.top()));
+    }
+
+    static void Require(std::string request, sp<BranchBase> br)
+    {
+        Match(request, br);
+    }
+
+    // Require in a single walk, nodes of capital letters in the request (B, V, I, E) are returned in order
+    static std::vector<sp<BranchBase>> Match(std::string request, sp<BranchBase> br)
+    {
+        RequireBranch(br);
+        std::vector<sp<BranchBase>> captures;
+        std::vector<Branch*> l{ static_cast<Branch*>(br.get()) };
+        std::vector<int> c_p{ 0 };
+        for (char c : request)
+        {
+            if (c == '.')
+            {
+                if (l.size() < 2)
+                    ExecutionEngineException::ThrowWraped("Require syntax error", ExecutionEngineException::Level::Critical);
+                l.pop_back();
+                c_p.pop_back();
+                continue;
+            }
+            if (c_p.back() >= l.back()->Branches.size())
+                ExecutionEngineException::ThrowWraped("Required argument, but not passed", ExecutionEngineException::Level::Critical);
+            const sp<BranchBase>& node = l.back()->Branches[c_p.back()++];
+            switch (c)
+            {
+            case 'b':
+            case 'B':
+                RequireBranch(node);
+                l.push_back(static_cast<Branch*>(node.get()));
+                c_p.push_back(0);
+                break;
+            case 'v':
+            case 'V':
+                RequireValue(node);
+                break;
+            case 'i':
+            case 'I':
+                RequireInteger(node);
+                break;
+            case 'e':
+            case 'E':
+                break;
+            default:
+                ExecutionEngineException::ThrowWraped("Require syntax error", ExecutionEngineException::Level::Critical);
+                break;
+            }
+            if (c >= 'A' && c <= 'Z')
+                captures.push_back(node);
+        }
+        return captures;
+    }
+
+private:
+#pragma region DEFAULT_STACK_OP
+    static void PackTop(Evaluator* eval)
+    {
+        if (eval->Data.size() == 0)
+            ExecutionEngineException::ThrowWraped("Required argument, but not passed", ExecutionEngineException::Level::Critical);
+        eval->Data.push(std::make_shared<Branch>(eval->Data, 1));
+    }
+    static void UnpackTop(Evaluator* eval)
+    {
+        eval->RequireBranchTop();
+        auto br = as_branch(eval->Data.top());
+        eval->Data.pop();
+        if (br.use_count() > 1)
+        {
+            auto& c = eval->Data.Container();
+            c.insert(c.end(), br->Branches.begin(), br->Branches.end());
+        }
+        else
+            br->Unpack(eval->Data);
+    }
+    static void PackTopSameLevel(Evaluator* eval)
+    {
+        sp<Branch> br = std::make_shared<Branch>();
+        int d = eval->Data.top()->Depth();
+        while (eval->Data.size() > 0 && eval->Data.top()->Depth() == d)
+        {
+            br->Branches.push_back(eval->Data.top());
+            eval->Data.pop();
+        }
+        eval->Data.push(br);
+    }
+    static void PackTopX(Evaluator* eval)
+    {
+        eval->RequireValueTop();
+        int c = Value::Read<int>(eval->Data.top().View());
+        eval->Data.pop();
+        if (eval->Data.size() < c)
+            ExecutionEngineException::ThrowWraped("Too few arguments to unpack", ExecutionEngineException::Level::Critical);
+        auto br = std::make_shared<Branch>(eval->Data, c);
+        eval->Data.push(br);
+    }
+    static void EmptyBranch(Evaluator* eval)
+    {
+        eval->Data.push(std::make_shared<Branch>());
+    }
+    static void EmptyElement(Evaluator* eval)
+    {
+        eval->Data.push(std::make_shared<Value>());
+    }
+    static void CopyFromIndex(Evaluator* eval)
+    {
+        eval->RequireValueTop();
+        int c = Value::Read<int>(eval->Data.top().View());
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        eval->Data.push(as_branch(eval->Data.top())->Branches[c]->Copy());
+    }
+    static void Undot(Evaluator* eval)
+    {
+        eval->RequireValueTop();
+        if (eval->Data.top().IsImmediate())
+        {
+            std::string_view v = eval->Data.top().View();
+            if (v.size() > 0 && v[0] == '.')
+                eval->Data.top() = Slot::Text(v.substr(1));
+            return;
+        }
+        eval->MakeTopUnique();
+        std::string& v = as_value(eval->Data.top())->Own();
+        if (v[0] == '.')
+            v = v.substr(1, v.size());
+    }
+    static void ExtractColumnPack(Evaluator* eval)
+    {
+        ExtractColumn(eval, false);
+    }
+    static void ExtractGroupedColumnPack(Evaluator* eval)
+    {
+        ExtractColumn(eval, true);
+    }
+    static void ExtractColumn(Evaluator* eval, bool grouped)
+    {
+        eval->RequireValueTop();
+        int index = Value::Read<int>(eval->Data.top().View());
+        eval->Data.pop();
+        eval->RequireValueTop();
+        int depth = Value::Read<int>(eval->Data.top().View());
+        eval->Data.pop();
+        if (depth < 1)
+            ExecutionEngineException::ThrowWraped("Cannot extract from zero depth", ExecutionEngineException::Level::Critical);
+        eval->RequireBranchTop();
+        PathCursor cursor(PathProgram::Column(depth, index), as_branch(eval->Data.top()));
+        eval->Data.push(Select(cursor, grouped, true));
+    }
+    static void SelectPath(Evaluator* eval)
+    {
+        SelectTop(eval, false);
+    }
+    static void SelectGroupedPath(Evaluator* eval)
+    {
+        SelectTop(eval, true);
+    }
+    static void SelectTop(Evaluator* eval, bool grouped)
+    {
+        eval->RequireValueTop();
+        auto program = eval->Selector(as_value(eval->Data.top())->View());
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        PathCursor cursor(program, as_branch(eval->Data.top()));
+        eval->Data.push(Select(cursor, grouped, false));
+    }
+    static void Reverse(Evaluator* eval)
+    {
+        eval->RequireTop();
+        if (eval->Data.top().IsImmediate())
+        {
+            std::string_view v = eval->Data.top().View();
+            eval->Data.top() = Slot::Text(std::string(v.rbegin(), v.rend()));
+            return;
+        }
+        eval->MakeTopUnique();
+        if (is_value(eval->Data.top()))
+        {
+            std::string& v = as_value(eval->Data.top())->Own();
+            std::reverse(v.begin(), v.end());
+        }
+        else
+        {
+            auto v = as_branch(eval->Data.top());
+            for (int i = 0; i < v->Branches.size() / 2; i++)
+                std::swap(v->Branches[i], v->Branches[v->Branches.size() - 1 - i]);
+        }
+    }
+    static void Copy(Evaluator* eval)
+    {
+        eval->RequireTop();
+        eval->Data.push(eval->Data.top().Clone());
+    }
+    static void Duplicate(Evaluator* eval)
+    {
+        eval->RequireIntegerTop();
+        int c = Value::Read<int>(eval->Data.top().View());
+        eval->Data.pop();
+        for (int i = 1; i < c; i++)
+            eval->Data.push(eval->Data.top().Clone());
+    }
+    static void DeepRemove(Evaluator* eval)
+    {
+        eval->RequireIntegerTop();
+        int c = Value::Read<int>(eval->Data.top().View());
+        eval->Data.pop();
+        eval->RequireTop(c + 1);
+        std::stack<sp<BranchBase>> tmp;
+        for (int i = 0; i < c; i++)
+        {
+            tmp.push(eval->Data.top());
+            eval->Data.pop();
+        }
+        eval->Data.pop();
+        for (int i = 0; i < c; i++)
+        {
+            eval->Data.push(tmp.top());
+            tmp.pop();
+        }
+    }
+    static void SplitRow(Evaluator* eval)
+    {
+        eval->RequireValueTop();
+        if (as_value(eval->Data.top())->IsEmpty())
+            ExecutionEngineException::ThrowWraped("Empty passed as split", ExecutionEngineException::Level::Critical);
+        auto searcher = eval->Searcher(as_value(eval->Data.top())->View());
+        eval->Data.pop();
+        eval->RequireValueTop();
+        auto source = as_value(eval->Data.top());
+        eval->Data.pop();
+        std::string_view value = source->View();
+        sp<Branch> r = std::make_shared<Branch>();
+        size_t p = 0;
+        for (size_t np = searcher->Find(value); np != std::string_view::npos; np = searcher->Find(value, p))
+        {
+            r->Branches.push_back(Value::Slice(source, p, np - p));
+            p = np + searcher->Size();
+        }
+        r->Branches.push_back(Value::Slice(source, p, value.size() - p));
+        eval->Data.push(r);
+    }
+    static void ConcatRow(Evaluator* eval)
+    {
+        eval->RequireValueTop();
+        std::string space(as_value(eval->Data.top())->View());
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        sp<Branch> br = as_branch(eval->Data.top());
+        eval->Data.pop();
+        std::stringstream str;
+        bool f = false;
+        for (auto& i : br->Branches)
+        {
+            if (i->Depth() == 0)
+            {
+                if (!f)
+                    f = true;
+                else
+                    str << space;
+                str << as_value(i)->View();
+            }
+        }
+        eval->Data.push(Value::Make(str.str()));
+    }
+    static void SetChild(Evaluator* eval)
+    {
+        int index = eval->PopInteger();
+        eval->RequireTop(2);
+        auto child = eval->Data.top();
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        eval->MakeTopUnique();
+        auto& br = as_branch(eval->Data.top())->Branches;
+        if (index >= br.size())
+            ExecutionEngineException::ThrowWraped("Index out of range", ExecutionEngineException::Level::Critical);
+        br[index] = std::move(child);
+    }
+    static void AppendChild(Evaluator* eval)
+    {
+        eval->RequireTop(2);
+        auto child = eval->Data.top();
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        eval->MakeTopUnique();
+        as_branch(eval->Data.top())->Branches.push_back(std::move(child));
+    }
+    static void InsertChild(Evaluator* eval)
+    {
+        int index = eval->PopInteger();
+        eval->RequireTop(2);
+        auto child = eval->Data.top();
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        eval->MakeTopUnique();
+        auto& br = as_branch(eval->Data.top())->Branches;
+        if (index > br.size())
+            ExecutionEngineException::ThrowWraped("Index out of range", ExecutionEngineException::Level::Critical);
+        br.insert(br.begin() + index, std::move(child));
+    }
+    static void RemoveChild(Evaluator* eval)
+    {
+        int index = eval->PopInteger();
+        eval->RequireBranchTop();
+        eval->MakeTopUnique();
+        auto& br = as_branch(eval->Data.top())->Branches;
+        if (index >= br.size())
+            ExecutionEngineException::ThrowWraped("Index out of range", ExecutionEngineException::Level::Critical);
+        br.erase(br.begin() + index);
+    }
+    static void SwapChildren(Evaluator* eval)
+    {
+        int second = eval->PopInteger();
+        int first = eval->PopInteger();
+        eval->RequireBranchTop();
+        eval->MakeTopUnique();
+        auto& br = as_branch(eval->Data.top())->Branches;
+        if (first >= br.size() || second >= br.size())
+            ExecutionEngineException::ThrowWraped("Index out of range", ExecutionEngineException::Level::Critical);
+        std::swap(br[first], br[second]);
+    }
+    static void SliceTop(Evaluator* eval, int step)
+    {
+        if (step == 0)
+            ExecutionEngineException::ThrowWraped("Zero slice step", ExecutionEngineException::Level::Critical);
+        SliceBounds bounds;
+        bounds.Step = step;
+        bounds.HasTo = eval->PopBound(bounds.To);
+        bounds.HasFrom = eval->PopBound(bounds.From);
+        eval->RequireTop();
+        bool value = is_value(eval->Data.top());
+        int size = value ? as_value(eval->Data.top())->View().size() : as_branch(eval->Data.top())->Branches.size();
+        int from = 0;
+        int count = bounds.Resolve(size, from);
+        if (value)
+        {
+            auto source = as_value(eval->Data.top());
+            if (step == 1)
+            {
+                eval->Data.push(Value::Slice(source, from, count));
+                return;
+            }
+            std::string_view src = source->View();
+            std::string r(count, '\0');
+            for (int i = 0; i < count; i++)
+                r[i] = src[from + i * step];
+            eval->Data.push(std::make_shared<Value>(std::move(r)));
+        }
+        else
+        {
+            auto source = as_branch(eval->Data.top());
+            auto& src = source->Branches;
+            sp<Branch> r = std::make_shared<Branch>();
+            if (step == 1)
+                r->Branches.assign(src.begin() + from, src.begin() + from + count);
+            else
+            {
+                r->Branches.resize(count);
+                for (int i = 0; i < count; i++)
+                    r->Branches[i] = src[from + i * step];
+            }
+            eval->Data.push(r);
+        }
+    }
+    static void Slice(Evaluator* eval)
+    {
+        SliceTop(eval, 1);
+    }
+    static void SliceStep(Evaluator* eval)
+    {
+        int step = 0;
+        if (!eval->PopBound(step))
+            step = 1;
+        SliceTop(eval, step);
+    }
+    // Resolves every index of an index branch against size, negative indices count from the end
+    static std::vector<size_t> ReadIndices(sp<Branch> indices, size_t size)
+    {
+        std::vector<size_t> res(indices->Branches.size());
+        Parallel::For(res.size(), [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto v = dynamic_cast<const Value*>(indices->Branches[i].get());
+                    if (v == nullptr)
+                        ExecutionEngineException::ThrowWraped("Branch as index", ExecutionEngineException::Level::Critical);
+                    std::string_view s = v->View();
+                    long long index = 0;
+                    auto r = std::from_chars(s.data(), s.data() + s.size(), index);
+                    if (r.ec != std::errc() || r.ptr != s.data() + s.size())
+                        ExecutionEngineException::ThrowWraped("Not a number passed as an integer", ExecutionEngineException::Level::Critical);
+                    if (index < 0)
+                        index += size;
+                    if (index < 0 || index >= (long long)size)
+                        ExecutionEngineException::ThrowWraped("Index out of range", ExecutionEngineException::Level::Critical);
+                    res[i] = index;
+                }
+            });
+        return res;
+    }
+    static void Gather(Evaluator* eval)
+    {
+        eval->RequireBranchTop();
+        sp<Branch> indices = as_branch(eval->Data.top());
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        auto source = as_branch(eval->Data.top());
+        auto& src = source->Branches;
+        auto idx = ReadIndices(indices, src.size());
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(idx.size());
+        Parallel::For(idx.size(), [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    r->Branches[i] = src[idx[i]];
+            });
+        eval->Data.push(r);
+    }
+    static void Scatter(Evaluator* eval)
+    {
+        eval->RequireBranchTop();
+        sp<Branch> indices = as_branch(eval->Data.top());
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        sp<Branch> values = as_branch(eval->Data.top());
+        eval->Data.pop();
+        if (values->Branches.size() != indices->Branches.size())
+            ExecutionEngineException::ThrowWraped("Scatter of different sizes", ExecutionEngineException::Level::Critical);
+        eval->RequireBranchTop();
+        eval->MakeTopUnique();
+        auto& dst = as_branch(eval->Data.top())->Branches;
+        auto idx = ReadIndices(indices, dst.size());
+        bool owned = values.use_count() < 2;
+        for (size_t i = 0; i < idx.size(); i++)
+            dst[idx[i]] = owned ? std::move(values->Branches[i]) : values->Branches[i];
+    }
+    // Builds rows out of equally sized columns, children of columns no one else holds are moved
+    static sp<Branch> Zip(std::vector<sp<Branch>>& columns)
+    {
+        size_t rows = columns.size() == 0 ? 0 : columns[0]->Branches.size();
+        std::vector<bool> owned(columns.size());
+        for (size_t c = 0; c < columns.size(); c++)
+        {
+            if (columns[c]->Branches.size() != rows)
+                ExecutionEngineException::ThrowWraped("Zip of branches with different sizes", ExecutionEngineException::Level::Critical);
+            owned[c] = columns[c].use_count() < 2;
+        }
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(rows);
+        Parallel::For(rows, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    sp<Branch> row = std::make_shared<Branch>();
+                    row->Branches.resize(columns.size());
+                    for (size_t c = 0; c < columns.size(); c++)
+                        row->Branches[c] = owned[c] ? std::move(columns[c]->Branches[i]) : columns[c]->Branches[i];
+                    r->Branches[i] = std::move(row);
+                }
+            });
+        return r;
+    }
+    static void ZipColumns(Evaluator* eval)
+    {
+        eval->RequireBranchTop();
+        sp<Branch> br = as_branch(eval->Data.top());
+        eval->Data.pop();
+        bool owned = br.use_count() < 2;
+        std::vector<sp<Branch>> columns(br->Branches.size());
+        for (size_t c = 0; c < columns.size(); c++)
+        {
+            RequireBranch(br->Branches[c]);
+            columns[c] = as_branch(br->Branches[c]);
+            if (owned)
+                br->Branches[c].reset();
+        }
+        eval->Data.push(Zip(columns));
+    }
+    static void ZipTopX(Evaluator* eval)
+    {
+        int c = eval->PopInteger();
+        eval->RequireTop(c);
+        std::vector<sp<Branch>> columns(c);
+        for (int i = c - 1; i > -1; i--)
+        {
+            eval->RequireBranchTop();
+            columns[i] = as_branch(eval->Data.top());
+            eval->Data.pop();
+        }
+        eval->Data.push(Zip(columns));
+    }
+    static void Unzip(Evaluator* eval)
+    {
+        eval->RequireBranchTop();
+        sp<Branch> br = as_branch(eval->Data.top());
+        eval->Data.pop();
+        bool owned = br.use_count() < 2;
+        size_t width = 0;
+        for (size_t i = 0; i < br->Branches.size(); i++)
+        {
+            RequireBranch(br->Branches[i]);
+            size_t w = static_cast<const Branch*>(br->Branches[i].get())->Branches.size();
+            if (i == 0)
+                width = w;
+            else if (w != width)
+                ExecutionEngineException::ThrowWraped("Unzip of rows with different sizes", ExecutionEngineException::Level::Critical);
+        }
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(width);
+        std::vector<Branch*> columns(width);
+        for (size_t c = 0; c < width; c++)
+        {
+            auto col = std::make_shared<Branch>();
+            col->Branches.resize(br->Branches.size());
+            columns[c] = col.get();
+            r->Branches[c] = std::move(col);
+        }
+        Parallel::For(br->Branches.size(), [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto row = static_cast<Branch*>(br->Branches[i].get());
+                    bool move = owned && br->Branches[i].use_count() < 2;
+                    for (size_t c = 0; c < width; c++)
+                        columns[c]->Branches[i] = move ? std::move(row->Branches[c]) : row->Branches[c];
+                }
+            });
+        eval->Data.push(r);
+    }
+    static void MatchTop(Evaluator* eval)
+    {
+        eval->RequireValueTop();
+        std::string request(as_value(eval->Data.top())->View());
+        eval->Data.pop();
+        eval->RequireBranchTop();
+        for (auto& i : Match(request, eval->Data.top()))
+            eval->Data.push(i);
+    }
+    enum class SetMode
+    {
+        Unique,
+        Union,
+        Intersect,
+        Difference,
+    };
+    // Children compared structurally through hashing, the result keeps the first occurrence order
+    static sp<Branch> SetOperation(const Branch& a, const Branch* b, SetMode mode)
+    {
+        size_t n = a.Branches.size();
+        size_t total = n + (b == nullptr ? 0 : b->Branches.size());
+        auto node = [&](size_t i) -> const sp<BranchBase>& { return i < n ? a.Branches[i] : b->Branches[i - n]; };
+        std::vector<size_t> hashes(total);
+        Parallel::For(total, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    hashes[i] = node(i)->Hash();
+            });
+        auto hash = [&](size_t i) { return hashes[i]; };
+        auto equal = [&](size_t x, size_t y) { return node(x) == node(y) || node(x)->Equals(*node(y)); };
+        std::unordered_set<size_t, decltype(hash), decltype(equal)> seen(total, hash, equal);
+        std::unordered_set<size_t, decltype(hash), decltype(equal)> other(0, hash, equal);
+        if (mode == SetMode::Intersect || mode == SetMode::Difference)
+            for (size_t i = n; i < total; i++)
+                other.insert(i);
+        size_t considered = mode == SetMode::Union ? total : n;
+        sp<Branch> res = std::make_shared<Branch>();
+        for (size_t i = 0; i < considered; i++)
+        {
+            if (mode == SetMode::Intersect && other.count(i) == 0)
+                continue;
+            if (mode == SetMode::Difference && other.count(i) != 0)
+                continue;
+            if (seen.insert(i).second)
+                res->Branches.push_back(node(i));
+        }
+        return res;
+    }
+    static void SetTop(Evaluator* eval, SetMode mode)
+    {
+        size_t operands = mode == SetMode::Unique ? 1 : 2;
+        for (size_t i = 0; i < operands && i < eval->Data.size(); i++)
+            if (IsDictionaryColumn(eval->Data.Container()[eval->Data.size() - 1 - i]))
+            {
+                DictionarySetTop(eval, mode);
+                return;
+            }
+        sp<Branch> b;
+        if (mode != SetMode::Unique)
+        {
+            eval->RequireBranchTop();
+            b = as_branch(eval->Data.top());
+            eval->Data.pop();
+        }
+        eval->RequireBranchTop();
+        sp<Branch> a = as_branch(eval->Data.top());
+        eval->Data.pop();
+        eval->Data.push(SetOperation(*a, b.get(), mode));
+    }
+    // Set operations on codes, the other operand is recoded into the dictionary of the first one
+    static void DictionarySetTop(Evaluator* eval, SetMode mode)
+    {
+        DictionaryColumn b;
+        if (mode != SetMode::Unique)
+            b = PopDictionary(eval);
+        DictionaryColumn a = PopDictionary(eval);
+        size_t n = a.Codes.size();
+        auto recode = a.Map(b.Entries, mode == SetMode::Union);
+        std::vector<char> seen(a.Entries.size()), other(a.Entries.size());
+        if (mode == SetMode::Intersect || mode == SetMode::Difference)
+            for (unsigned code : b.Codes)
+                if (recode[code] != DictionaryColumn::Missing)
+                    other[recode[code]] = 1;
+        DictionaryColumn res;
+        res.Entries = std::move(a.Entries);
+        size_t considered = mode == SetMode::Union ? n + b.Codes.size() : n;
+        for (size_t i = 0; i < considered; i++)
+        {
+            unsigned code = i < n ? a.Codes[i] : recode[b.Codes[i - n]];
+            if (mode == SetMode::Intersect && !other[code])
+                continue;
+            if (mode == SetMode::Difference && other[code])
+                continue;
+            if (!seen[code])
+            {
+                seen[code] = 1;
+                res.Codes.push_back(code);
+            }
+        }
+        eval->Data.push(res.Encode());
+    }
+    static void Unique(Evaluator* eval)
+    {
+        SetTop(eval, SetMode::Unique);
+    }
+    static void Union(Evaluator* eval)
+    {
+        SetTop(eval, SetMode::Union);
+    }
+    static void Intersect(Evaluator* eval)
+    {
+        SetTop(eval, SetMode::Intersect);
+    }
+    static void Difference(Evaluator* eval)
+    {
+        SetTop(eval, SetMode::Difference);
+    }
+    // Order argument of S operations: optional '-' for descending, 'n' numeric or 's' string, optional key column
+    // ("n", "-s", "n2"), keys are read once so comparisons never parse
+    struct OrderSpec
+    {
+        bool Numeric{ false };
+        bool Descending{ false };
+        int Key{ -1 };
+        std::vector<double> Numbers{};
+        std::vector<std::string_view> Texts{};
+
+        static OrderSpec Pop(Evaluator* eval)
+        {
+            eval->RequireValueTop();
+            std::string_view spec = as_value(eval->Data.top())->View();
+            OrderSpec res;
+            if (spec.size() > 0 && spec[0] == '-')
+            {
+                res.Descending = true;
+                spec.remove_prefix(1);
+            }
+            if (spec.size() == 0 || (spec[0] != 'n' && spec[0] != 's'))
+                ExecutionEngineException::ThrowWraped("Order syntax error", ExecutionEngineException::Level::Critical);
+            res.Numeric = spec[0] == 'n';
+            spec.remove_prefix(1);
+            if (spec.size() > 0)
+            {
+                auto r = std::from_chars(spec.data(), spec.data() + spec.size(), res.Key);
+                if (r.ec != std::errc() || r.ptr != spec.data() + spec.size() || res.Key < 0)
+                    ExecutionEngineException::ThrowWraped("Order syntax error", ExecutionEngineException::Level::Critical);
+            }
+            eval->Data.pop();
+            return res;
+        }
+
+        std::string_view KeyOf(const BranchBase* node) const
+        {
+            if (Key >= 0)
+            {
+                auto br = dynamic_cast<const Branch*>(node);
+                if (br == nullptr)
+                    ExecutionEngineException::ThrowWraped("Value as branch argument", ExecutionEngineException::Level::Critical);
+                if (Key >= br->Branches.size())
+                    ExecutionEngineException::ThrowWraped("Required argument, but not passed", ExecutionEngineException::Level::Critical);
+                node = br->Branches[Key].get();
+            }
+            auto v = dynamic_cast<const Value*>(node);
+            if (v == nullptr)
+                ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+            return v->View();
+        }
+
+        void Set(size_t i, std::string_view key)
+        {
+            if (!Numeric)
+            {
+                Texts[i] = key;
+                return;
+            }
+            auto r = std::from_chars(key.data(), key.data() + key.size(), Numbers[i]);
+            if (key.size() == 0 || r.ec != std::errc() || r.ptr != key.data() + key.size())
+                ExecutionEngineException::ThrowWraped("Not a number passed as a number", ExecutionEngineException::Level::Critical);
+        }
+
+        void Resize(size_t n)
+        {
+            if (Numeric)
+                Numbers.resize(n);
+            else
+                Texts.resize(n);
+        }
+
+        // Keys of every child
+        void Load(const Branch& br)
+        {
+            size_t n = br.Branches.size();
+            Resize(n);
+            Parallel::For(n, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                        Set(i, KeyOf(br.Branches[i].get()));
+                });
+        }
+
+        bool Less(size_t x, size_t y) const noexcept
+        {
+            if (Descending)
+                std::swap(x, y);
+            return Numeric ? Numbers[x] < Numbers[y] : Texts[x] < Texts[y];
+        }
+    };
+    static void TopK(Evaluator* eval)
+    {
+        int k = eval->PopInteger();
+        OrderSpec order = OrderSpec::Pop(eval);
+        eval->RequireBranchTop();
+        auto source = as_branch(eval->Data.top());
+        auto& src = source->Branches;
+        order.Load(*source);
+        // Greatest first, ties keep the earlier child
+        auto before = [&](size_t x, size_t y) { return order.Less(y, x) || (!order.Less(x, y) && x < y); };
+        size_t chunk = std::max<size_t>(Parallel::MinChunk, k);
+        std::vector<std::vector<size_t>> partial((src.size() + chunk - 1) / chunk);
+        Parallel::Tasks(partial.size(), [&](size_t c)
+            {
+                std::priority_queue<size_t, std::vector<size_t>, decltype(before)> heap(before);
+                for (size_t i = c * chunk; i < std::min(src.size(), (c + 1) * chunk); i++)
+                {
+                    if (heap.size() < k)
+                        heap.push(i);
+                    else if (k > 0 && before(i, heap.top()))
+                    {
+                        heap.pop();
+                        heap.push(i);
+                    }
+                }
+                for (; !heap.empty(); heap.pop())
+                    partial[c].push_back(heap.top());
+            });
+        std::vector<size_t> merged;
+        for (auto& p : partial)
+            merged.insert(merged.end(), p.begin(), p.end());
+        size_t taken = std::min<size_t>(k, merged.size());
+        std::partial_sort(merged.begin(), merged.begin() + taken, merged.end(), before);
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(taken);
+        for (size_t i = 0; i < taken; i++)
+            r->Branches[i] = src[merged[i]];
+        eval->Data.push(r);
+    }
+    static void NthElement(Evaluator* eval)
+    {
+        int n = eval->PopInteger();
+        OrderSpec order = OrderSpec::Pop(eval);
+        eval->RequireBranchTop();
+        auto source = as_branch(eval->Data.top());
+        auto& src = source->Branches;
+        if (n >= src.size())
+            ExecutionEngineException::ThrowWraped("Index out of range", ExecutionEngineException::Level::Critical);
+        order.Load(*source);
+        std::vector<size_t> positions(src.size());
+        for (size_t i = 0; i < positions.size(); i++)
+            positions[i] = i;
+        std::nth_element(positions.begin(), positions.begin() + n, positions.end(), [&](size_t x, size_t y) { return order.Less(x, y); });
+        eval->Data.push(src[positions[n]]);
+    }
+    // Index of the first child of a sorted branch that is not ordered before the probe. Only two keys are held:
+    // the probe in slot 0 and the child being compared in slot 1, so a lookup reads O(log n) children
+    static size_t SearchTop(Evaluator* eval, bool& found)
+    {
+        eval->RequireValueTop();
+        auto probe = as_value(eval->Data.top());
+        eval->Data.pop();
+        OrderSpec order = OrderSpec::Pop(eval);
+        eval->RequireBranchTop();
+        auto source = as_branch(eval->Data.top());
+        auto& br = source->Branches;
+        size_t n = br.size();
+        order.Resize(2);
+        order.Set(0, probe->View());
+        size_t low = 0, high = n;
+        while (low < high)
+        {
+            size_t mid = low + (high - low) / 2;
+            order.Set(1, order.KeyOf(br[mid].get()));
+            if (order.Less(1, 0))
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        found = false;
+        if (low < n)
+        {
+            order.Set(1, order.KeyOf(br[low].get()));
+            found = !order.Less(0, 1);
+        }
+        return low;
+    }
+    static void LowerBound(Evaluator* eval)
+    {
+        bool found;
+        size_t index = SearchTop(eval, found);
+        eval->Data.push(Slot::Text(std::to_string(index)));
+    }
+    static void BinarySearch(Evaluator* eval)
+    {
+        bool found;
+        size_t index = SearchTop(eval, found);
+        eval->Data.push(Slot::Text(found ? std::to_string(index) : "-1"));
+    }
+    // Builds partial sketches over chunks of a value column in parallel and merges them in chunk order
+    template<typename Sketch, typename Make, typename Add>
+    static Sketch BuildSketch(const Branch& column, Make make, Add add)
+    {
+        size_t chunks = std::max<size_t>(1, (column.Branches.size() + Parallel::MinChunk - 1) / Parallel::MinChunk);
+        std::vector<Sketch> partial;
+        for (size_t c = 0; c < chunks; c++)
+            partial.push_back(make(c));
+        Parallel::Tasks(chunks, [&](size_t c)
+            {
+                for (size_t i = c * Parallel::MinChunk; i < std::min(column.Branches.size(), (c + 1) * Parallel::MinChunk); i++)
+                {
+                    auto v = dynamic_cast<const Value*>(column.Branches[i].get());
+                    if (v == nullptr)
+                        ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+                    add(partial[c], v->View());
+                }
+            });
+        for (size_t c = 1; c < chunks; c++)
+            partial[0].Merge(partial[c]);
+        return std::move(partial[0]);
+    }
+    static sp<Branch> PopColumn(Evaluator* eval)
+    {
+        eval->RequireBranchTop();
+        sp<Branch> column = as_branch(eval->Data.top());
+        eval->Data.pop();
+        return column;
+    }
+    static std::string_view SketchTop(Evaluator* eval, int depth = 0)
+    {
+        auto v = dynamic_cast<const Value*>(eval->Data.Container()[eval->Data.size() - 1 - depth].get());
+        if (v == nullptr || v->Kind != Value::Encoding::Sketch || v->View().size() == 0)
+            ExecutionEngineException::ThrowWraped("Not a sketch passed as a sketch", ExecutionEngineException::Level::Critical);
+        return v->View();
+    }
+    static void SketchDistinct(Evaluator* eval)
+    {
+        auto column = PopColumn(eval);
+        auto sketch = BuildSketch<HyperLogLog>(*column, [](size_t) { return HyperLogLog(); }, [](HyperLogLog& s, std::string_view v) { s.Add(v); });
+        eval->Data.push(std::make_shared<Value>(sketch.Serialize(), Value::Encoding::Sketch));
+    }
+    static void SketchQuantiles(Evaluator* eval)
+    {
+        auto column = PopColumn(eval);
+        auto sketch = BuildSketch<TDigest>(*column, [](size_t) { return TDigest(); }, [](TDigest& s, std::string_view v)
+            {
+                double x;
+                auto r = std::from_chars(v.data(), v.data() + v.size(), x);
+                if (v.size() == 0 || r.ec != std::errc() || r.ptr != v.data() + v.size())
+                    ExecutionEngineException::ThrowWraped("Not a number passed as a number", ExecutionEngineException::Level::Critical);
+                s.Add(x);
+            });
+        eval->Data.push(std::make_shared<Value>(sketch.Serialize(), Value::Encoding::Sketch));
+    }
+    static void SketchSample(Evaluator* eval)
+    {
+        int k = eval->PopInteger();
+        auto column = PopColumn(eval);
+        auto sketch = BuildSketch<Reservoir>(*column, [&](size_t c) { return Reservoir(k, c); }, [](Reservoir& s, std::string_view v) { s.Add(v); });
+        eval->Data.push(std::make_shared<Value>(sketch.Serialize(), Value::Encoding::Sketch));
+    }
+    static void SketchMerge(Evaluator* eval)
+    {
+        eval->RequireTop(2);
+        std::string_view a = SketchTop(eval, 1), b = SketchTop(eval);
+        if (a[0] != b[0])
+            ExecutionEngineException::ThrowWraped("Merging sketches of different kinds", ExecutionEngineException::Level::Critical);
+        std::string merged;
+        if (a[0] == 'H')
+        {
+            auto s = HyperLogLog::Deserialize(a);
+            s.Merge(HyperLogLog::Deserialize(b));
+            merged = s.Serialize();
+        }
+        else if (a[0] == 'T')
+        {
+            auto s = TDigest::Deserialize(a);
+            s.Merge(TDigest::Deserialize(b));
+            merged = s.Serialize();
+        }
+        else
+        {
+            auto s = Reservoir::Deserialize(a);
+            auto other = Reservoir::Deserialize(b);
+            s.Merge(other);
+            merged = s.Serialize();
+        }
+        eval->Data.pop();
+        eval->Data.pop();
+        eval->Data.push(std::make_shared<Value>(merged, Value::Encoding::Sketch));
+    }
+    static void SketchEstimate(Evaluator* eval)
+    {
+        eval->RequireTop();
+        if (is_value(eval->Data.top()) && as_value(eval->Data.top())->Kind == Value::Encoding::Text)
+        {
+            eval->RequireValueTop();
+            double q;
+            if (!NumberText::ParseReal(eval->Data.top().View(), q))
+                ExecutionEngineException::ThrowWraped("Not a number passed as a number", ExecutionEngineException::Level::Critical);
+            if (!(q >= 0 && q <= 1))
+                ExecutionEngineException::ThrowWraped("Quantile out of range", ExecutionEngineException::Level::Critical);
+            eval->RequireTop(2);
+            auto digest = TDigest::Deserialize(SketchTop(eval, 1));
+            eval->Data.pop();
+            eval->Data.push(std::make_shared<Value>(NumberText::Format(digest.Quantile(q))));
+            return;
+        }
+        std::string_view sketch = SketchTop(eval);
+        if (sketch[0] == 'H')
+            eval->Data.push(std::make_shared<Value>(std::to_string((long long)std::llround(HyperLogLog::Deserialize(sketch).Estimate()))));
+        else if (sketch[0] == 'R')
+        {
+            sp<Branch> r = std::make_shared<Branch>();
+            for (auto& i : Reservoir::Deserialize(sketch).Items)
+                r->Branches.push_back(std::make_shared<Value>(i));
+            eval->Data.push(r);
+        }
+        else
+            ExecutionEngineException::ThrowWraped("Quantile required for the sketch", ExecutionEngineException::Level::Critical);
+    }
+    // Numbers of a value column parsed once, integers stay exact while every value is one
+    struct NumberColumn
+    {
+        std::vector<double> Real{};
+        std::vector<long long> Integer{};
+        bool Integral{ true };
+
+        // With failures given, unparsable positions are listed there and read as 0 instead of throwing
+        static NumberColumn Read(const Branch& column, std::vector<size_t>* failures = nullptr)
+        {
+            NumberColumn res;
+            size_t n = column.Branches.size();
+            res.Real.resize(n);
+            res.Integer.resize(n);
+            std::vector<char> failed(failures != nullptr ? n : 0);
+            std::atomic<bool> integral{ true };
+            Parallel::For(n, [&](size_t begin, size_t end)
+                {
+                    bool local = true;
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        auto v = dynamic_cast<const Value*>(column.Branches[i].get());
+                        if (v == nullptr)
+                            ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+                        std::string_view s = v->View();
+                        if (NumberText::ParseInteger(s, res.Integer[i]))
+                        {
+                            res.Real[i] = (double)res.Integer[i];
+                            continue;
+                        }
+                        const char* e = s.data() + s.size();
+                        auto r = std::from_chars(s.data(), e, res.Real[i]);
+                        if (s.size() == 0 || r.ec != std::errc() || r.ptr != e)
+                        {
+                            if (failures == nullptr)
+                                ExecutionEngineException::ThrowWraped("Not a number passed as a number", ExecutionEngineException::Level::Critical);
+                            failed[i] = 1;
+                            res.Real[i] = 0;
+                            res.Integer[i] = 0;
+                            continue;
+                        }
+                        local = false;
+                    }
+                    if (!local)
+                        integral = false;
+                });
+            res.Integral = integral;
+            for (size_t i = 0; i < failed.size(); i++)
+                if (failed[i])
+                    failures->push_back(i);
+            return res;
+        }
+
+        // Typed columns keep the numbers as a native array in the payload
+        static NumberColumn Decode(const Value& typed)
+        {
+            NumberColumn res;
+            std::string_view payload = typed.View();
+            size_t n = payload.size() / 8;
+            res.Integral = typed.Kind == Value::Encoding::Int64;
+            res.Real.resize(n);
+            res.Integer.resize(n);
+            if (n == 0)
+                return res;
+            if (res.Integral)
+            {
+                std::memcpy(res.Integer.data(), payload.data(), n * 8);
+                for (size_t i = 0; i < n; i++)
+                    res.Real[i] = (double)res.Integer[i];
+            }
+            else
+                std::memcpy(res.Real.data(), payload.data(), n * 8);
+            return res;
+        }
+
+        sp<Value> Encode() const
+        {
+            std::string payload(Real.size() * 8, '\0');
+            if (payload.size() > 0)
+                std::memcpy(&payload[0], Integral ? (const void*)Integer.data() : (const void*)Real.data(), payload.size());
+            return std::make_shared<Value>(std::move(payload), Integral ? Value::Encoding::Int64 : Value::Encoding::Float64);
+        }
+    };
+    static bool IsTypedColumn(const sp<BranchBase>& node)
+    {
+        auto v = dynamic_cast<const Value*>(node.get());
+        return v != nullptr && (v->Kind == Value::Encoding::Int64 || v->Kind == Value::Encoding::Float64);
+    }
+    // Numbers from a typed column or a branch of values on top
+    static NumberColumn PopNumbers(Evaluator* eval)
+    {
+        eval->RequireTop();
+        if (IsTypedColumn(eval->Data.top()))
+        {
+            NumberColumn res = NumberColumn::Decode(*as_value(eval->Data.top()));
+            eval->Data.pop();
+            return res;
+        }
+        if (IsCompressedColumn(eval->Data.top()))
+        {
+            NumberColumn res;
+            CompressedColumn::Open(*as_value(eval->Data.top())).Decode(res.Integer);
+            eval->Data.pop();
+            res.Real.resize(res.Integer.size());
+            for (size_t i = 0; i < res.Integer.size(); i++)
+                res.Real[i] = (double)res.Integer[i];
+            return res;
+        }
+        auto column = PopColumn(eval);
+        return NumberColumn::Read(*column);
+    }
+    // Pushes the typed column and the positions that failed to parse
+    static void ParseColumn(Evaluator* eval)
+    {
+        auto column = PopColumn(eval);
+        std::vector<size_t> failures;
+        NumberColumn col = NumberColumn::Read(*column, &failures);
+        eval->Data.push(col.Encode());
+        sp<Branch> r = std::make_shared<Branch>();
+        for (size_t i : failures)
+            r->Branches.push_back(std::make_shared<Value>(std::to_string(i)));
+        eval->Data.push(r);
+    }
+    static void FormatColumn(Evaluator* eval)
+    {
+        eval->RequireTop();
+        if (!IsTypedColumn(eval->Data.top()))
+            ExecutionEngineException::ThrowWraped("Not a typed column passed as a typed column", ExecutionEngineException::Level::Critical);
+        NumberColumn col = PopNumbers(eval);
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(col.Real.size());
+        Parallel::For(r->Branches.size(), [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    r->Branches[i] = std::make_shared<Value>(col.Integral ? std::to_string(col.Integer[i]) : NumberText::Format(col.Real[i]));
+            });
+        eval->Data.push(r);
+    }
+    // Integer column kept compressed as runs, as blocks of offsets from the block minimum (frame of reference)
+    // or as blocks of offsets from the smallest step between neighbours (delta). Blocks record their bounds so
+    // aggregates and range filters skip or summarize them without unpacking. Packed bits are little endian.
+    class CompressedColumn
+    {
+    public:
+        enum class Scheme : unsigned char
+        {
+            Runs,
+            Frame,
+            Delta,
+        };
+        struct Run
+        {
+            long long Value;
+            unsigned long long Length;
+        };
+        struct Block
+        {
+            long long Min, Max, Base, Step;
+            unsigned long long Bits;
+        };
+
+        static constexpr size_t BlockSize = 128;
+
+        Scheme Kind{ Scheme::Runs };
+        size_t Count{ 0 };
+
+        // Encodes with the scheme giving the smallest payload
+        static sp<Value> Encode(const std::vector<long long>& x)
+        {
+            size_t runs = 0;
+            for (size_t i = 0; i < x.size(); i++)
+                runs += i == 0 || x[i] != x[i - 1];
+            std::string best = EncodeBlocks(x, Scheme::Frame), delta = EncodeBlocks(x, Scheme::Delta);
+            if (delta.size() < best.size())
+                best = std::move(delta);
+            if (HeaderSize + runs * sizeof(Run) <= best.size())
+            {
+                best = Header(Scheme::Runs, x.size());
+                for (size_t i = 0; i < x.size();)
+                {
+                    Run run{ x[i], 0 };
+                    for (; i < x.size() && x[i] == run.Value; i++)
+                        run.Length++;
+                    best.append((const char*)&run, sizeof(run));
+                }
+            }
+            return std::make_shared<Value>(std::move(best), Value::Encoding::Compressed);
+        }
+
+        // The column keeps pointing into the payload of typed
+        static CompressedColumn Open(const Value& typed)
+        {
+            CompressedColumn res;
+            std::string_view payload = typed.View();
+            unsigned long long count = 0;
+            if (payload.size() < HeaderSize || (unsigned char)payload[0] > (unsigned char)Scheme::Delta)
+                ExecutionEngineException::ThrowWraped("Corrupted compressed column", ExecutionEngineException::Level::Critical);
+            res.Kind = (Scheme)payload[0];
+            std::memcpy(&count, payload.data() + 8, sizeof(count));
+            res.Count = count;
+            payload.remove_prefix(HeaderSize);
+            if (res.Kind == Scheme::Runs)
+            {
+                if (payload.size() % sizeof(Run) != 0)
+                    ExecutionEngineException::ThrowWraped("Corrupted compressed column", ExecutionEngineException::Level::Critical);
+                res.runs_.resize(payload.size() / sizeof(Run));
+                if (payload.size() > 0)
+                    std::memcpy(res.runs_.data(), payload.data(), payload.size());
+                unsigned long long total = 0;
+                for (auto& r : res.runs_)
+                    total += r.Length;
+                if (total != count)
+                    ExecutionEngineException::ThrowWraped("Corrupted compressed column", ExecutionEngineException::Level::Critical);
+                return res;
+            }
+            size_t blocks = (res.Count + BlockSize - 1) / BlockSize;
+            res.blocks_.resize(blocks);
+            res.packed_.resize(blocks);
+            for (size_t b = 0; b < blocks; b++)
+            {
+                if (payload.size() < sizeof(Block))
+                    ExecutionEngineException::ThrowWraped("Corrupted compressed column", ExecutionEngineException::Level::Critical);
+                std::memcpy(&res.blocks_[b], payload.data(), sizeof(Block));
+                payload.remove_prefix(sizeof(Block));
+                size_t bytes = PackedSize(res.BlockCount(b) - (res.Kind == Scheme::Delta), res.blocks_[b].Bits);
+                if (res.blocks_[b].Bits > 64 || payload.size() < bytes + Slack)
+                    ExecutionEngineException::ThrowWraped("Corrupted compressed column", ExecutionEngineException::Level::Critical);
+                res.packed_[b] = (const unsigned char*)payload.data();
+                payload.remove_prefix(bytes);
+            }
+            return res;
+        }
+
+        void Decode(std::vector<long long>& out) const
+        {
+            out.resize(Count);
+            if (Kind == Scheme::Runs)
+            {
+                size_t p = 0;
+                for (auto& r : runs_)
+                    for (size_t i = 0; i < r.Length; i++)
+                        out[p++] = r.Value;
+                return;
+            }
+            Parallel::For(blocks_.size(), [&](size_t begin, size_t end)
+                {
+                    for (size_t b = begin; b < end; b++)
+                        DecodeBlock(b, out.data() + b * BlockSize);
+                });
+        }
+
+        // Exact sum, blocks whose bounds rule out an overflow are summed in wrapping 64 bit arithmetic
+        NumberText::WideSum Sum() const
+        {
+            NumberText::WideSum total;
+            if (Kind == Scheme::Runs)
+            {
+                for (auto& r : runs_)
+                    total.Add(r.Value, r.Length);
+                return total;
+            }
+            std::vector<NumberText::WideSum> partial(blocks_.size());
+            Parallel::For(blocks_.size(), [&](size_t begin, size_t end)
+                {
+                    long long buffer[BlockSize];
+                    for (size_t b = begin; b < end; b++)
+                    {
+                        auto& block = blocks_[b];
+                        size_t n = BlockCount(b);
+                        long long low, high;
+                        if (!NumberText::MultiplyExact(block.Min, (long long)n, low) || !NumberText::MultiplyExact(block.Max, (long long)n, high))
+                        {
+                            DecodeBlock(b, buffer);
+                            for (size_t i = 0; i < n; i++)
+                                partial[b].Add(buffer[i]);
+                        }
+                        // Otherwise the block sum lies within [low, high] and the wrapping sums below are exact
+                        else if (block.Min == block.Max)
+                            partial[b].Add(low);
+                        else if (Kind == Scheme::Frame)
+                        {
+                            unsigned long long offsets[BlockSize], total = 0;
+                            Unpack(packed_[b], n, block.Bits, offsets);
+                            for (size_t i = 0; i < n; i++)
+                                total += offsets[i];
+                            partial[b].Add((long long)((unsigned long long)block.Base * n + total));
+                        }
+                        else
+                        {
+                            unsigned long long total = 0;
+                            DecodeBlock(b, buffer);
+                            for (size_t i = 0; i < n; i++)
+                                total += (unsigned long long)buffer[i];
+                            partial[b].Add((long long)total);
+                        }
+                    }
+                });
+            for (auto& p : partial)
+                total.Add(p);
+            return total;
+        }
+
+        // Extremes come from the run values or the block bounds
+        long long Extreme(bool max) const
+        {
+            if (Count == 0)
+                ExecutionEngineException::ThrowWraped("Empty column", ExecutionEngineException::Level::Critical);
+            long long res = Kind == Scheme::Runs ? runs_[0].Value : max ? blocks_[0].Max : blocks_[0].Min;
+            for (auto& r : runs_)
+                res = max ? std::max(res, r.Value) : std::min(res, r.Value);
+            for (auto& b : blocks_)
+                res = max ? std::max(res, b.Max) : std::min(res, b.Min);
+            return res;
+        }
+
+        // Calls f(begin, end) for every range of positions holding values within [low, high]
+        template<typename Emit>
+        void Within(long long low, long long high, Emit f) const
+        {
+            if (Kind == Scheme::Runs)
+            {
+                size_t p = 0;
+                for (auto& r : runs_)
+                {
+                    if (r.Value >= low && r.Value <= high)
+                        f(p, p + r.Length);
+                    p += r.Length;
+                }
+                return;
+            }
+            long long buffer[BlockSize];
+            for (size_t b = 0; b < blocks_.size(); b++)
+            {
+                auto& block = blocks_[b];
+                size_t n = BlockCount(b), first = b * BlockSize;
+                if (block.Max < low || block.Min > high)
+                    continue;
+                if (block.Min >= low && block.Max <= high)
+                {
+                    f(first, first + n);
+                    continue;
+                }
+                DecodeBlock(b, buffer);
+                for (size_t i = 0; i < n; i++)
+                    if (buffer[i] >= low && buffer[i] <= high)
+                        f(first + i, first + i + 1);
+            }
+        }
+
+    private:
+        // Scheme byte and the value count, padded to keep the rest aligned
+        static constexpr size_t HeaderSize = 16;
+        // Unpacking loads eight bytes at a time, the payload ends with this many spare bytes
+        static constexpr size_t Slack = 8;
+
+        std::vector<Run> runs_{};
+        std::vector<Block> blocks_{};
+        std::vector<const unsigned char*> packed_{};
+
+        size_t BlockCount(size_t b) const noexcept
+        {
+            return std::min(BlockSize, Count - b * BlockSize);
+        }
+        static size_t PackedSize(size_t n, unsigned long long bits) noexcept
+        {
+            return (size_t)((n * bits + 7) / 8);
+        }
+        static std::string Header(Scheme kind, unsigned long long count)
+        {
+            std::string res(HeaderSize, '\0');
+            res[0] = (char)kind;
+            std::memcpy(&res[8], &count, sizeof(count));
+            return res;
+        }
+        static unsigned long long Load(const unsigned char* p) noexcept
+        {
+            const unsigned short probe = 1;
+            unsigned long long res = 0;
+            if (*reinterpret_cast<const unsigned char*>(&probe) == 1)
+            {
+                std::memcpy(&res, p, 8);
+                return res;
+            }
+            for (int k = 0; k < 8; k++)
+                res |= (unsigned long long)p[k] << (8 * k);
+            return res;
+        }
+        // Widths up to 56 bits are read with one unaligned load per value and a shared mask, the loop has no
+        // branches so the compiler can vectorize it
+        static void Unpack(const unsigned char* packed, size_t n, unsigned long long bits, unsigned long long* out) noexcept
+        {
+            if (bits == 0)
+            {
+                std::fill(out, out + n, 0ull);
+                return;
+            }
+            unsigned long long mask = bits == 64 ? ~0ull : (1ull << bits) - 1;
+            if (bits <= 56)
+            {
+                for (size_t i = 0, bit = 0; i < n; i++, bit += bits)
+                    out[i] = (Load(packed + bit / 8) >> (bit & 7)) & mask;
+                return;
+            }
+            for (size_t i = 0, bit = 0; i < n; i++, bit += bits)
+            {
+                unsigned shift = bit & 7;
+                unsigned long long v = Load(packed + bit / 8) >> shift;
+                if (shift > 0)
+                    v |= (unsigned long long)packed[bit / 8 + 8] << (64 - shift);
+                out[i] = v & mask;
+            }
+        }
+        void DecodeBlock(size_t b, long long* out) const noexcept
+        {
+            auto& block = blocks_[b];
+            size_t n = BlockCount(b);
+            unsigned long long offsets[BlockSize];
+            if (Kind == Scheme::Frame)
+            {
+                Unpack(packed_[b], n, block.Bits, offsets);
+                for (size_t i = 0; i < n; i++)
+                    out[i] = (long long)((unsigned long long)block.Base + offsets[i]);
+                return;
+            }
+            Unpack(packed_[b], n - 1, block.Bits, offsets);
+            unsigned long long v = (unsigned long long)block.Base;
+            out[0] = block.Base;
+            for (size_t i = 1; i < n; i++)
+            {
+                v += (unsigned long long)block.Step + offsets[i - 1];
+                out[i] = (long long)v;
+            }
+        }
+        static std::string EncodeBlocks(const std::vector<long long>& x, Scheme kind)
+        {
+            std::string res = Header(kind, x.size());
+            unsigned long long offsets[BlockSize];
+            for (size_t first = 0; first < x.size(); first += BlockSize)
+            {
+                size_t n = std::min(BlockSize, x.size() - first);
+                Block block{ x[first], x[first], x[first], 0, 0 };
+                for (size_t i = 1; i < n; i++)
+                {
+                    block.Min = std::min(block.Min, x[first + i]);
+                    block.Max = std::max(block.Max, x[first + i]);
+                }
+                size_t packed = n;
+                if (kind == Scheme::Frame)
+                {
+                    block.Base = block.Min;
+                    for (size_t i = 0; i < n; i++)
+                        offsets[i] = (unsigned long long)x[first + i] - (unsigned long long)block.Base;
+                }
+                else
+                {
+                    packed = n - 1;
+                    for (size_t i = 1; i < n; i++)
+                    {
+                        long long step = (long long)((unsigned long long)x[first + i] - (unsigned long long)x[first + i - 1]);
+                        block.Step = i == 1 ? step : std::min(block.Step, step);
+                    }
+                    for (size_t i = 1; i < n; i++)
+                        offsets[i - 1] = (unsigned long long)x[first + i] - (unsigned long long)x[first + i - 1] - (unsigned long long)block.Step;
+                }
+                unsigned long long widest = 0;
+                for (size_t i = 0; i < packed; i++)
+                    widest |= offsets[i];
+                while (block.Bits < 64 && (widest >> block.Bits) != 0)
+                    block.Bits++;
+                res.append((const char*)&block, sizeof(block));
+                size_t at = res.size();
+                res.resize(at + PackedSize(packed, block.Bits));
+                for (size_t i = 0; i < packed; i++)
+                    for (unsigned long long done = 0, bit = i * block.Bits; done < block.Bits;)
+                    {
+                        unsigned shift = bit & 7;
+                        unsigned take = (unsigned)std::min<unsigned long long>(8 - shift, block.Bits - done);
+                        res[at + bit / 8] |= (char)(((offsets[i] >> done) & ((1u << take) - 1)) << shift);
+                        done += take;
+                        bit += take;
+                    }
+            }
+            res.append(Slack, '\0');
+            return res;
+        }
+    };
+    static bool IsCompressedColumn(const sp<BranchBase>& node)
+    {
+        auto v = dynamic_cast<const Value*>(node.get());
+        return v != nullptr && v->Kind == Value::Encoding::Compressed;
+    }
+    static void CompressColumn(Evaluator* eval)
+    {
+        NumberColumn col = PopNumbers(eval);
+        if (!col.Integral)
+            ExecutionEngineException::ThrowWraped("Not an integer column passed as an integer column", ExecutionEngineException::Level::Critical);
+        eval->Data.push(CompressedColumn::Encode(col.Integer));
+    }
+    static void DecompressColumn(Evaluator* eval)
+    {
+        eval->RequireTop();
+        if (!IsCompressedColumn(eval->Data.top()))
+            ExecutionEngineException::ThrowWraped("Not a compressed column passed as a compressed column", ExecutionEngineException::Level::Critical);
+        eval->Data.push(PopNumbers(eval).Encode());
+    }
+    // Whole column aggregates, compressed columns are summarized without unpacking them first. Integer sums are
+    // exact while they fit a long long and rounded once to a double when they do not
+    static void ColumnAggregate(Evaluator* eval, int op)
+    {
+        eval->RequireTop();
+        if (IsCompressedColumn(eval->Data.top()))
+        {
+            auto typed = as_value(eval->Data.top());
+            eval->Data.pop();
+            auto column = CompressedColumn::Open(*typed);
+            eval->Data.push(Slot::Text(op == 0 ? column.Sum().Text() : std::to_string(column.Extreme(op > 0))));
+            return;
+        }
+        NumberColumn col = PopNumbers(eval);
+        size_t n = col.Real.size();
+        if (op != 0 && n == 0)
+            ExecutionEngineException::ThrowWraped("Empty column", ExecutionEngineException::Level::Critical);
+        if (col.Integral)
+        {
+            NumberText::WideSum total;
+            long long res = n == 0 ? 0 : col.Integer[0];
+            for (long long x : col.Integer)
+                if (op == 0)
+                    total.Add(x);
+                else
+                    res = op > 0 ? std::max(res, x) : std::min(res, x);
+            eval->Data.push(Slot::Text(op == 0 ? total.Text() : std::to_string(res)));
+            return;
+        }
+        double sum = 0, carry = 0, res = col.Real[0];
+        for (double x : col.Real)
+            if (op == 0)
+            {
+                double t = sum + x;
+                carry += std::abs(sum) >= std::abs(x) ? (sum - t) + x : (x - t) + sum;
+                sum = t;
+            }
+            else
+                res = op > 0 ? std::max(res, x) : std::min(res, x);
+        eval->Data.push(Slot::Text(NumberText::Format(op == 0 ? sum + carry : res)));
+    }
+    static void ColumnSum(Evaluator* eval)
+    {
+        ColumnAggregate(eval, 0);
+    }
+    static void ColumnMin(Evaluator* eval)
+    {
+        ColumnAggregate(eval, -1);
+    }
+    static void ColumnMax(Evaluator* eval)
+    {
+        ColumnAggregate(eval, 1);
+    }
+    // Positions of the values within the inclusive bounds on top, integer columns round fractional bounds inwards
+    static void ColumnRange(Evaluator* eval)
+    {
+        eval->RequireValueTop();
+        std::string high(eval->Data.top().View());
+        eval->Data.pop();
+        eval->RequireValueTop();
+        std::string low(eval->Data.top().View());
+        eval->Data.pop();
+        double bounds[2];
+        for (int k = 0; k < 2; k++)
+        {
+            const std::string& s = k == 0 ? low : high;
+            auto r = std::from_chars(s.data(), s.data() + s.size(), bounds[k]);
+            if (s.size() == 0 || r.ec != std::errc() || r.ptr != s.data() + s.size())
+                ExecutionEngineException::ThrowWraped("Not a number passed as a number", ExecutionEngineException::Level::Critical);
+        }
+        auto integer = [&](int k)
+            {
+                long long exact;
+                if (NumberText::ParseInteger(k == 0 ? low : high, exact))
+                    return exact;
+                double b = k == 0 ? std::ceil(bounds[0]) : std::floor(bounds[1]);
+                if (b <= -9.2e18)
+                    return std::numeric_limits<long long>::min();
+                if (b >= 9.2e18)
+                    return std::numeric_limits<long long>::max();
+                return (long long)b;
+            };
+        sp<Branch> r = std::make_shared<Branch>();
+        auto emit = [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    r->Branches.push_back(Value::Make(std::to_string(i)));
+            };
+        eval->RequireTop();
+        if (IsCompressedColumn(eval->Data.top()))
+        {
+            auto typed = as_value(eval->Data.top());
+            eval->Data.pop();
+            auto column = CompressedColumn::Open(*typed);
+            column.Within(integer(0), integer(1), emit);
+        }
+        else
+        {
+            NumberColumn col = PopNumbers(eval);
+            long long low_i = integer(0), high_i = integer(1);
+            for (size_t i = 0; i < col.Real.size(); i++)
+                if (col.Integral ? col.Integer[i] >= low_i && col.Integer[i] <= high_i : col.Real[i] >= bounds[0] && col.Real[i] <= bounds[1])
+                    emit(i, i + 1);
+        }
+        eval->Data.push(r);
+    }
+    // Runs the pipeline spec on top over the rows of the branch below it in a single pass, morsels of rows
+    // are spread over the workers and their results combined in input order
+    static void RunPipeline(Evaluator* eval)
+    {
+        eval->RequireValueTop();
+        auto program = eval->Pipeline(eval->Data.top().View());
+        eval->Data.pop();
+        auto input = PopColumn(eval);
+        size_t n = input->Branches.size(), size = std::max<size_t>(1, Parallel::MorselSize);
+        size_t morsels = (n + size - 1) / size;
+        bool aggregate = program->Final != PipelineProgram::Total::None;
+        std::vector<std::unique_ptr<PipelineProgram::Cursor>> cursors(Parallel::Workers(n, size));
+        std::vector<sp<Branch>> parts(aggregate ? 0 : morsels);
+        std::vector<PipelineProgram::Totals> partial(aggregate ? morsels : 0);
+        Parallel::Morsels(n, size, [&](size_t m, size_t begin, size_t end, size_t w)
+            {
+                if (cursors[w] == nullptr)
+                    cursors[w] = std::make_unique<PipelineProgram::Cursor>(*program);
+                if (!aggregate)
+                    parts[m] = std::make_shared<Branch>();
+                cursors[w]->Run(*input, begin, end, aggregate ? nullptr : parts[m].get(), aggregate ? &partial[m] : nullptr);
+            });
+        if (aggregate)
+        {
+            PipelineProgram::Totals totals;
+            for (auto& t : partial)
+                totals.Merge(t);
+            eval->Data.push(Slot::Text(totals.Result(program->Final)));
+            return;
+        }
+        // Morsel results are moved into place at their offsets, concatenated in input order
+        std::vector<size_t> offsets(morsels + 1);
+        for (size_t m = 0; m < morsels; m++)
+            offsets[m + 1] = offsets[m] + parts[m]->Branches.size();
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(offsets[morsels]);
+        Parallel::Tasks(morsels, [&](size_t m)
+            {
+                std::move(parts[m]->Branches.begin(), parts[m]->Branches.end(), r->Branches.begin() + offsets[m]);
+            });
+        eval->Data.push(r);
+    }
+    // Low cardinality value column: one code per row into a dictionary of the distinct values in first occurrence order.
+    // The payload holds the entry count, the code width in bytes, the length prefixed entries and then the codes.
+    struct DictionaryColumn
+    {
+        static constexpr unsigned Missing = ~0u;
+
+        std::vector<std::string_view> Entries{};
+        std::vector<unsigned> Codes{};
+        // Nodes the entries point into
+        std::vector<sp<const BranchBase>> Owners{};
+
+        // Chunks are encoded in parallel with their own dictionaries, merged in chunk order and recoded
+        static DictionaryColumn Read(const sp<Branch>& column)
+        {
+            DictionaryColumn res;
+            res.Owners.push_back(column);
+            size_t n = column->Branches.size();
+            res.Codes.resize(n);
+            size_t chunks = std::max<size_t>(1, (n + Parallel::MinChunk - 1) / Parallel::MinChunk);
+            std::vector<std::vector<std::string_view>> local(chunks);
+            auto range = [&](size_t c) { return std::make_pair(c * Parallel::MinChunk, std::min(n, (c + 1) * Parallel::MinChunk)); };
+            Parallel::Tasks(chunks, [&](size_t c)
+                {
+                    std::unordered_map<std::string_view, unsigned> codes;
+                    auto [begin, end] = range(c);
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        auto v = dynamic_cast<const Value*>(column->Branches[i].get());
+                        if (v == nullptr)
+                            ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+                        auto it = codes.try_emplace(v->View(), (unsigned)local[c].size());
+                        if (it.second)
+                            local[c].push_back(v->View());
+                        res.Codes[i] = it.first->second;
+                    }
+                });
+            std::vector<std::vector<unsigned>> recode(chunks);
+            std::unordered_map<std::string_view, unsigned> known;
+            for (size_t c = 0; c < chunks; c++)
+                recode[c] = res.Map(local[c], true, known);
+            if (chunks > 1)
+                Parallel::Tasks(chunks, [&](size_t c)
+                    {
+                        auto [begin, end] = range(c);
+                        for (size_t i = begin; i < end; i++)
+                            res.Codes[i] = recode[c][res.Codes[i]];
+                    });
+            return res;
+        }
+
+        // Entries view the payload of typed
+        static DictionaryColumn Decode(const sp<Value>& typed)
+        {
+            DictionaryColumn res;
+            res.Owners.push_back(typed);
+            std::string_view payload = typed->View();
+            unsigned header[2];
+            if (payload.size() < sizeof(header))
+                ExecutionEngineException::ThrowWraped("Corrupted dictionary column", ExecutionEngineException::Level::Critical);
+            std::memcpy(header, payload.data(), sizeof(header));
+            size_t p = sizeof(header), width = header[1];
+            if (width != 1 && width != 2 && width != 4)
+                ExecutionEngineException::ThrowWraped("Corrupted dictionary column", ExecutionEngineException::Level::Critical);
+            res.Entries.reserve(header[0]);
+            for (unsigned e = 0; e < header[0]; e++)
+            {
+                unsigned size;
+                if (payload.size() - p < sizeof(size))
+                    ExecutionEngineException::ThrowWraped("Corrupted dictionary column", ExecutionEngineException::Level::Critical);
+                std::memcpy(&size, payload.data() + p, sizeof(size));
+                p += sizeof(size);
+                if (payload.size() - p < size)
+                    ExecutionEngineException::ThrowWraped("Corrupted dictionary column", ExecutionEngineException::Level::Critical);
+                res.Entries.push_back(payload.substr(p, size));
+                p += size;
+            }
+            if ((payload.size() - p) % width != 0)
+                ExecutionEngineException::ThrowWraped("Corrupted dictionary column", ExecutionEngineException::Level::Critical);
+            res.Codes.resize((payload.size() - p) / width);
+            const unsigned char* codes = (const unsigned char*)payload.data() + p;
+            for (size_t i = 0; i < res.Codes.size(); i++)
+            {
+                unsigned code = 0;
+                if (width == 1)
+                    code = codes[i];
+                else if (width == 2)
+                {
+                    unsigned short narrow;
+                    std::memcpy(&narrow, codes + i * 2, sizeof(narrow));
+                    code = narrow;
+                }
+                else if (width == 4)
+                    std::memcpy(&code, codes + i * 4, sizeof(code));
+                if (code >= header[0])
+                    ExecutionEngineException::ThrowWraped("Corrupted dictionary column", ExecutionEngineException::Level::Critical);
+                res.Codes[i] = code;
+            }
+            return res;
+        }
+
+        // Codes take the narrowest width that fits the dictionary
+        sp<Value> Encode() const
+        {
+            unsigned header[2] = { (unsigned)Entries.size(), Entries.size() <= 0x100 ? 1u : Entries.size() <= 0x10000 ? 2u : 4u };
+            size_t size = sizeof(header) + Codes.size() * header[1];
+            for (auto e : Entries)
+                size += sizeof(unsigned) + e.size();
+            std::string payload(size, '\0');
+            char* p = &payload[0];
+            std::memcpy(p, header, sizeof(header));
+            p += sizeof(header);
+            for (auto e : Entries)
+            {
+                unsigned length = (unsigned)e.size();
+                std::memcpy(p, &length, sizeof(length));
+                p += sizeof(length);
+                if (length > 0)
+                    std::memcpy(p, e.data(), length);
+                p += length;
+            }
+            for (unsigned code : Codes)
+            {
+                if (header[1] == 1)
+                    *p++ = (char)code;
+                else if (header[1] == 2)
+                {
+                    unsigned short narrow = (unsigned short)code;
+                    std::memcpy(p, &narrow, sizeof(narrow));
+                    p += sizeof(narrow);
+                }
+                else
+                {
+                    std::memcpy(p, &code, sizeof(code));
+                    p += sizeof(code);
+                }
+            }
+            return std::make_shared<Value>(std::move(payload), Value::Encoding::Dictionary);
+        }
+
+        // Code of every given entry in this dictionary, entries not found are added with extend or get Missing
+        std::vector<unsigned> Map(const std::vector<std::string_view>& entries, bool extend)
+        {
+            std::unordered_map<std::string_view, unsigned> known(Entries.size() * 2);
+            for (size_t e = 0; e < Entries.size(); e++)
+                known.emplace(Entries[e], (unsigned)e);
+            return Map(entries, extend, known);
+        }
+
+        // As above with known holding the code of every entry, kept in step with Entries across calls
+        std::vector<unsigned> Map(const std::vector<std::string_view>& entries, bool extend, std::unordered_map<std::string_view, unsigned>& known)
+        {
+            std::vector<unsigned> res(entries.size());
+            for (size_t e = 0; e < entries.size(); e++)
+            {
+                auto it = known.find(entries[e]);
+                if (it != known.end())
+                    res[e] = it->second;
+                else if (!extend)
+                    res[e] = Missing;
+                else
+                {
+                    res[e] = (unsigned)Entries.size();
+                    known.emplace(entries[e], res[e]);
+                    Entries.push_back(entries[e]);
+                }
+            }
+            return res;
         }
-    }
-
-    static void RequireValue(sp<BranchBase> br)
+    };
+    static bool IsDictionaryColumn(const sp<BranchBase>& node)
     {
-        if (!is_value(br))
-            ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+        auto v = dynamic_cast<const Value*>(node.get());
+        return v != nullptr && v->Kind == Value::Encoding::Dictionary;
     }
-
-    static void RequireBranch(sp<BranchBase> br)
+    // Codes of a dictionary column or of a branch of values encoded on the fly
+    static DictionaryColumn PopDictionary(Evaluator* eval)
     {
-        if (!is_branch(br))
-            ExecutionEngineException::ThrowWraped("Value as branch argument", ExecutionEngineException::Level::Critical);
+        eval->RequireTop();
+        if (IsDictionaryColumn(eval->Data.top()))
+        {
+            DictionaryColumn res = DictionaryColumn::Decode(as_value(eval->Data.top()));
+            eval->Data.pop();
+            return res;
+        }
+        return DictionaryColumn::Read(PopColumn(eval));
     }
-
-    static void RequireInteger(sp<BranchBase> br)
+    static void EncodeDictionary(Evaluator* eval)
     {
-        RequireValue(br);
-        auto v = as_value(br);
-        if (v->Stored.size() > 8)
-            ExecutionEngineException::ThrowWraped("Number larger than integer", ExecutionEngineException::Level::Critical);
-        if (v->IsEmpty())
-            ExecutionEngineException::ThrowWraped("Passing empty as number", ExecutionEngineException::Level::Critical);
-        for (int i = 0; i < v->Stored.size(); i++)
-            if (v->Stored[i] < '0' || v->Stored[i] > '9')
-                ExecutionEngineException::ThrowWraped("Not a number passed as an integer", ExecutionEngineException::Level::Critical);
+        eval->Data.push(PopDictionary(eval).Encode());
     }
-
-    void RequireTop(int sz = 1)
+    // Rows with the same code share one value node
+    static void DecodeDictionary(Evaluator* eval)
     {
-        if (Data.size() < sz)
-            ExecutionEngineException::ThrowWraped("Required argument, but not passed", ExecutionEngineException::Level::Critical);
+        eval->RequireTop();
+        if (!IsDictionaryColumn(eval->Data.top()))
+            ExecutionEngineException::ThrowWraped("Not a dictionary column passed as a dictionary column", ExecutionEngineException::Level::Critical);
+        DictionaryColumn col = PopDictionary(eval);
+        std::vector<sp<BranchBase>> values(col.Entries.size());
+        for (size_t e = 0; e < values.size(); e++)
+            values[e] = Value::Make(col.Entries[e]);
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(col.Codes.size());
+        Parallel::For(col.Codes.size(), [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    r->Branches[i] = values[col.Codes[i]];
+            });
+        eval->Data.push(r);
     }
-
-    void RequireValueTop()
+    // Pushes the distinct values in first occurrence order and a branch with the row positions of each of them
+    static void GroupDictionary(Evaluator* eval)
     {
-        RequireTop();
-        RequireValue(Data.top());
+        DictionaryColumn col = PopDictionary(eval);
+        std::vector<size_t> counts(col.Entries.size());
+        for (unsigned code : col.Codes)
+            counts[code]++;
+        std::vector<Branch*> groups(col.Entries.size());
+        sp<Branch> keys = std::make_shared<Branch>(), positions = std::make_shared<Branch>();
+        std::vector<unsigned> order;
+        for (unsigned code : col.Codes)
+            if (groups[code] == nullptr)
+            {
+                auto group = std::make_shared<Branch>();
+                group->Branches.reserve(counts[code]);
+                groups[code] = group.get();
+                keys->Branches.push_back(Value::Make(col.Entries[code]));
+                positions->Branches.push_back(std::move(group));
+            }
+        for (size_t i = 0; i < col.Codes.size(); i++)
+            groups[col.Codes[i]]->Branches.push_back(Value::Make(std::to_string(i)));
+        eval->Data.push(keys);
+        eval->Data.push(positions);
     }
-
-    void RequireIntegerTop()
+    // Positions of the rows equal to a value, or to the same row of another column, compared by code
+    static void EqualDictionary(Evaluator* eval)
     {
-        RequireTop();
-        RequireInteger(Data.top());
+        eval->RequireTop();
+        sp<BranchBase> key = eval->Data.top();
+        bool single = is_value(key) && !IsDictionaryColumn(key);
+        DictionaryColumn other;
+        if (single)
+            eval->Data.pop();
+        else
+            other = PopDictionary(eval);
+        DictionaryColumn col = PopDictionary(eval);
+        sp<Branch> r = std::make_shared<Branch>();
+        if (single)
+        {
+            unsigned code = col.Map({ as_value(key)->View() }, false)[0];
+            if (code != DictionaryColumn::Missing)
+                for (size_t i = 0; i < col.Codes.size(); i++)
+                    if (col.Codes[i] == code)
+                        r->Branches.push_back(Value::Make(std::to_string(i)));
+        }
+        else
+        {
+            if (other.Codes.size() != col.Codes.size())
+                ExecutionEngineException::ThrowWraped("Comparison of columns with different sizes", ExecutionEngineException::Level::Critical);
+            auto codes = col.Map(other.Entries, false);
+            for (size_t i = 0; i < col.Codes.size(); i++)
+                if (codes[other.Codes[i]] == col.Codes[i])
+                    r->Branches.push_back(Value::Make(std::to_string(i)));
+        }
+        eval->Data.push(r);
     }
-
-    void RequireBranchTop()
+    static NumberColumn PopWindow(Evaluator* eval, int& window)
     {
-        RequireTop();
-        RequireBranch(Data.top());
+        window = eval->PopInteger();
+        if (window < 1)
+            ExecutionEngineException::ThrowWraped("Empty window", ExecutionEngineException::Level::Critical);
+        return PopNumbers(eval);
     }
-
-    static void Require(std::string request, sp<BranchBase> br)
+    // One result per full window of the column, integer sums are exact
+    static void RollingTotal(Evaluator* eval, bool mean)
     {
-        RequireBranch(br);
-        std::stack<sp<Branch>> l;
-        std::stack<int> c_p;
-        l.push(as_branch(br));
-        int index = 0;
-        do
+        int w = 0;
+        NumberColumn col = PopWindow(eval, w);
+        size_t n = col.Real.size();
+        size_t windows = n < w ? 0 : n - w + 1;
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(windows);
+        if (col.Integral)
         {
-            if (request[index] == '.')
+            // 128 bit prefix sums, no window can overflow; sums that do not fit a long long are printed as doubles
+            std::vector<NumberText::WideSum> prefix(n + 1);
+            for (size_t i = 0; i < n; i++)
             {
-                l.pop();
-                c_p.pop();
+                prefix[i + 1] = prefix[i];
+                prefix[i + 1].Add(col.Integer[i]);
             }
-            else if (request[index] == 'b')
+            for (size_t i = 0; i < windows; i++)
             {
-                RequireBranch(l.top()->Branches[c_p.top()]);
-                l.push(as_branch(l.top()->Branches[c_p.top()]));
-                c_p.top()++;
-                c_p.push(0);
+                auto sum = prefix[i + w] - prefix[i];
+                r->Branches[i] = std::make_shared<Value>(mean ? NumberText::Format(sum.Real() / w) : sum.Text());
             }
-            switch (request[index])
+        }
+        else
+        {
+            // Compensated running sum, the error does not grow with the column length
+            double sum = 0, carry = 0;
+            auto add = [&](double x)
+                {
+                    double t = sum + x;
+                    carry += std::abs(sum) >= std::abs(x) ? (sum - t) + x : (x - t) + sum;
+                    sum = t;
+                };
+            for (size_t i = 0; i < n; i++)
             {
-            case '.':
-                l.pop();
-                c_p.pop();
-                break;
-            case 'b':
-                RequireBranch(l.top()->Branches[c_p.top()]);
-                l.push(as_branch(l.top()->Branches[c_p.top()]));
-                c_p.top()++;
-                c_p.push(0);
-                break;
-            case 'v':
-                RequireValue(l.top()->Branches[c_p.top()]);
-                c_p.top()++;
-                break;
-            case 'i':
-                RequireInteger(l.top()->Branches[c_p.top()]);
-                c_p.top()++;
-                break;
-            case 'e':
-                l.top()->Branches[c_p.top()];
-                c_p.top()++;
-                break;
-            default:
-                ExecutionEngineException::ThrowWraped("Require syntax error", ExecutionEngineException::Level::Critical);
-                break;
+                add(col.Real[i]);
+                if (i >= w)
+                    add(-col.Real[i - w]);
+                if (i + 1 >= w)
+                    r->Branches[i + 1 - w] = std::make_shared<Value>(NumberText::Format(mean ? (sum + carry) / w : sum + carry));
             }
-            index++;
-        } while (index < request.size());
+        }
+        eval->Data.push(r);
     }
-
-private:
-#pragma region DEFAULT_STACK_OP
-    static void PackTop(Evaluator* eval)
+    // Monotonic deque of window positions, every position enters and leaves it once. Integer columns are
+    // compared and printed exactly
+    static void RollingExtreme(Evaluator* eval, bool max)
     {
-        if (eval->Data.size() == 0)
-            ExecutionEngineException::ThrowWraped("Required argument, but not passed", ExecutionEngineException::Level::Critical);
-        eval->Data.push(std::make_shared<Branch>(eval->Data, 1));
+        int w = 0;
+        NumberColumn col = PopWindow(eval, w);
+        size_t n = col.Real.size();
+        std::deque<size_t> window;
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.reserve(n < w ? 0 : n - w + 1);
+        auto slide = [&](const auto& x, auto format)
+            {
+                for (size_t i = 0; i < n; i++)
+                {
+                    while (window.size() > 0 && (max ? x[window.back()] <= x[i] : x[window.back()] >= x[i]))
+                        window.pop_back();
+                    window.push_back(i);
+                    if (window.front() + w <= i)
+                        window.pop_front();
+                    if (i + 1 >= w)
+                        r->Branches.push_back(std::make_shared<Value>(format(x[window.front()])));
+                }
+            };
+        if (col.Integral)
+            slide(col.Integer, [](long long x) { return std::to_string(x); });
+        else
+            slide(col.Real, [](double x) { return NumberText::Format(x); });
+        eval->Data.push(r);
     }
-    static void UnpackTop(Evaluator* eval)
+    static void RollingSum(Evaluator* eval)
     {
-        eval->RequireBranchTop();
-        auto br = eval->Data.top();
-        eval->Data.pop();
-        as_branch(br)->Unpack(eval->Data);
+        RollingTotal(eval, false);
     }
-    static void PackTopSameLevel(Evaluator* eval)
+    static void RollingMean(Evaluator* eval)
     {
-        sp<Branch> br = std::make_shared<Branch>();
-        int d = eval->Data.top()->Depth();
-        while (eval->Data.size() > 0 && eval->Data.top()->Depth() == d)
+        RollingTotal(eval, true);
+    }
+    static void RollingMin(Evaluator* eval)
+    {
+        RollingExtreme(eval, false);
+    }
+    static void RollingMax(Evaluator* eval)
+    {
+        RollingExtreme(eval, true);
+    }
+    // Applies f to the value on top, or to every child value of the branch on top in parallel
+    template<typename Apply>
+    static void MapValuesTop(Evaluator* eval, Apply f)
+    {
+        eval->RequireTop();
+        if (is_value(eval->Data.top()))
         {
-            br->Branches.push_back(eval->Data.top());
+            Slot top = eval->Data.top();
             eval->Data.pop();
+            eval->Data.push(Slot::Text(f(top.View())));
+            return;
         }
-        eval->Data.push(br);
+        MapTop(eval, [&](std::string_view v) -> sp<BranchBase> { return Value::Make(f(v)); });
     }
-    static void PackTopX(Evaluator* eval)
+    // Same as MapValuesTop with f producing a node per value
+    template<typename Apply>
+    static void MapTop(Evaluator* eval, Apply f)
     {
-        eval->RequireValueTop();
-        int c = as_value(eval->Data.top())->ReadAs<int>();
+        eval->RequireTop();
+        auto top = eval->Data.top();
         eval->Data.pop();
-        if (eval->Data.size() < c)
-            ExecutionEngineException::ThrowWraped("Too few arguments to unpack", ExecutionEngineException::Level::Critical);
-        auto br = std::make_shared<Branch>(eval->Data, c);
-        eval->Data.push(br);
+        if (is_value(top))
+        {
+            eval->Data.push(f(as_value(top)->View()));
+            return;
+        }
+        auto& src = as_branch(top)->Branches;
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(src.size());
+        Parallel::For(src.size(), [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto v = dynamic_cast<const Value*>(src[i].get());
+                    if (v == nullptr)
+                        ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+                    r->Branches[i] = f(v->View());
+                }
+            });
+        eval->Data.push(r);
     }
-    static void EmptyBranch(Evaluator* eval)
+    static void ReverseUtf8(Evaluator* eval)
     {
-        eval->Data.push(std::make_shared<Branch>());
+        MapValuesTop(eval, [](std::string_view v) { return Utf8::Reverse(v); });
     }
-    static void EmptyElement(Evaluator* eval)
+    static void LengthUtf8(Evaluator* eval)
     {
-        eval->Data.push(std::make_shared<Value>());
+        MapValuesTop(eval, [](std::string_view v) { return std::to_string(Utf8::Length(v)); });
     }
-    static void CopyFromIndex(Evaluator* eval)
+    // An empty separator splits into code points
+    static void SplitUtf8(Evaluator* eval)
     {
         eval->RequireValueTop();
-        int c = as_value(eval->Data.top())->ReadAs<int>();
+        std::string_view separator = as_value(eval->Data.top())->View();
+        Utf8::Validate(separator);
+        auto searcher = separator.size() > 0 ? eval->Searcher(separator) : nullptr;
+        auto owner = eval->Data.top();
         eval->Data.pop();
-        eval->RequireBranchTop();
-        eval->Data.push(as_branch(eval->Data.top())->Branches[c]->Copy());
+        MapTop(eval, [&](std::string_view v) -> sp<BranchBase>
+            {
+                sp<Branch> r = std::make_shared<Branch>();
+                if (searcher == nullptr)
+                {
+                    Utf8::ForEach(v, [&](size_t offset, size_t size)
+                        {
+                            r->Branches.push_back(Value::Make(v.substr(offset, size)));
+                        });
+                    return r;
+                }
+                Utf8::Validate(v);
+                size_t p = 0;
+                for (size_t np = searcher->Find(v); np != std::string_view::npos; np = searcher->Find(v, p))
+                {
+                    r->Branches.push_back(Value::Make(v.substr(p, np - p)));
+                    p = np + searcher->Size();
+                }
+                r->Branches.push_back(Value::Make(v.substr(p)));
+                return r;
+            });
     }
-    static void Undot(Evaluator* eval)
+    static sp<const TextSearcher> PopSearcher(Evaluator* eval)
     {
         eval->RequireValueTop();
-        std::string& v = as_value(eval->Data.top())->Stored;
-        if (v[0] == '.')
-            v = v.substr(1, v.size());
+        if (as_value(eval->Data.top())->IsEmpty())
+            ExecutionEngineException::ThrowWraped("Empty passed as pattern", ExecutionEngineException::Level::Critical);
+        auto searcher = eval->Searcher(as_value(eval->Data.top())->View());
+        eval->Data.pop();
+        return searcher;
     }
-    static void ExtractColumnPack(Evaluator* eval)
+    static void FindRow(Evaluator* eval)
     {
-        eval->RequireValueTop();
-        int index = as_value(eval->Data.top())->ReadAs<int>();
-        eval->Data.pop();
-        eval->RequireValueTop();
-        int depth = as_value(eval->Data.top())->ReadAs<int>();
-        eval->Data.pop();
-        if (depth < 1)
-            ExecutionEngineException::ThrowWraped("Cannot extract from zero depth", ExecutionEngineException::Level::Critical);
-        eval->RequireBranchTop();
-        sp<Branch> nbranch = std::make_shared<Branch>();
-        std::stack<sp<Branch>> br;
-        br.push(as_branch(eval->Data.top()));
-        std::stack<int> cp;
-        cp.push(0);
-        while (br.size() != 0)
-        {
-            if (cp.top() >= br.top()->Branches.size())
-            {
-                cp.pop();
-                br.pop();
-                continue;
-            }
-            if (br.size() == depth)
-            {
-                if (index < br.top()->Branches.size())
-                    nbranch->Branches.push_back(br.top()->Branches[index]->Copy());
-                br.pop();
-                cp.pop();
-                continue;
-            }
-            if (is_branch(br.top()->Branches[cp.top()]))
-            {
-                br.push(as_branch(br.top()->Branches[cp.top()]));
-                cp.top()++;
-                cp.push(0);
-            }
-            else
+        auto searcher = PopSearcher(eval);
+        MapValuesTop(eval, [&](std::string_view v)
             {
-                cp.top()++;
-            }
-        }
-        eval->Data.push(nbranch);
+                size_t p = searcher->Find(v);
+                return p == std::string_view::npos ? std::string("-1") : std::to_string(p);
+            });
     }
-    static void ExtractGroupedColumnPack(Evaluator* eval)
+    static void CountRow(Evaluator* eval)
+    {
+        auto searcher = PopSearcher(eval);
+        MapValuesTop(eval, [&](std::string_view v) { return std::to_string(searcher->Count(v)); });
+    }
+    static void ReplaceRow(Evaluator* eval)
     {
         eval->RequireValueTop();
-        int index = as_value(eval->Data.top())->ReadAs<int>();
-        eval->Data.pop();
-        eval->RequireValueTop();
-        int depth = as_value(eval->Data.top())->ReadAs<int>();
+        auto replacement = as_value(eval->Data.top());
         eval->Data.pop();
-        if (depth < 1)
-            ExecutionEngineException::ThrowWraped("Cannot extract from zero depth", ExecutionEngineException::Level::Critical);
+        auto searcher = PopSearcher(eval);
+        MapValuesTop(eval, [&](std::string_view v) { return searcher->Replace(v, replacement->View()); });
+    }
+    // Matches every value against a branch of patterns, a result lists the distinct pattern indices found
+    // in ascending order or, as a mask, holds '1' at the position of every pattern found
+    static void MatchPatternsTop(Evaluator* eval, bool mask)
+    {
         eval->RequireBranchTop();
-        sp<Branch> nbranch = std::make_shared<Branch>();
-        std::stack<sp<Branch>> br;
-        std::stack<sp<Branch>> nbr;
-        nbr.push(nbranch);
-        br.push(as_branch(eval->Data.top()));
-        std::stack<int> cp;
-        cp.push(0);
-        while (br.size() != 0)
-        {
-            if (cp.top() >= br.top()->Branches.size())
-            {
-                cp.pop();
-                br.pop();
-                nbr.pop();
-                continue;
-            }
-            if (br.size() == depth)
-            {
-                if (index < br.top()->Branches.size())
-                    nbr.top()->Branches.push_back(br.top()->Branches[index]->Copy());
-                br.pop();
-                cp.pop();
-                nbr.pop();
-                continue;
-            }
-            if (is_branch(br.top()->Branches[cp.top()]))
-            {
-                br.push(as_branch(br.top()->Branches[cp.top()]));
-                cp.top()++;
-                cp.push(0);
-                auto b_ = std::make_shared<Branch>();
-                nbr.top()->Branches.push_back(b_);
-                nbr.push(b_);
-
-            }
-            else
+        auto searcher = eval->MultiSearcherOf(*as_branch(eval->Data.top()));
+        eval->Data.pop();
+        eval->RequireTop();
+        auto top = eval->Data.top();
+        eval->Data.pop();
+        bool single = is_value(top);
+        sp<Branch> targets = single ? std::make_shared<Branch>() : as_branch(top);
+        if (single)
+            targets->Branches.push_back(top);
+        size_t patterns = searcher->Patterns.size();
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(targets->Branches.size());
+        Parallel::For(targets->Branches.size(), [&](size_t begin, size_t end)
             {
-                cp.top()++;
-            }
-        }
-        eval->Data.push(nbranch);
+                std::string found(patterns, '0');
+                std::vector<int> hits;
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto v = dynamic_cast<const Value*>(targets->Branches[i].get());
+                    if (v == nullptr)
+                        ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+                    searcher->Scan(v->View(), [&](int p)
+                        {
+                            if (found[p] == '0')
+                            {
+                                found[p] = '1';
+                                hits.push_back(p);
+                            }
+                        });
+                    if (mask)
+                        r->Branches[i] = std::make_shared<Value>(found);
+                    else
+                    {
+                        std::sort(hits.begin(), hits.end());
+                        sp<Branch> list = std::make_shared<Branch>();
+                        list->Branches.reserve(hits.size());
+                        for (int p : hits)
+                            list->Branches.push_back(std::make_shared<Value>(std::to_string(p)));
+                        r->Branches[i] = list;
+                    }
+                    for (int p : hits)
+                        found[p] = '0';
+                    hits.clear();
+                }
+            });
+        eval->Data.push(single ? r->Branches[0] : r);
     }
-    static void Reverse(Evaluator* eval)
+    static void MatchPatterns(Evaluator* eval)
+    {
+        MatchPatternsTop(eval, false);
+    }
+    static void MatchPatternsMask(Evaluator* eval)
     {
+        MatchPatternsTop(eval, true);
+    }
+    // Applies f to the value on top, or to every child value of the branch on top with one matcher per chunk
+    template<typename Apply>
+    static void RegexTop(Evaluator* eval, Apply f)
+    {
+        eval->RequireValueTop();
+        auto program = eval->Regex(as_value(eval->Data.top())->View());
+        eval->Data.pop();
         eval->RequireTop();
-        if (is_value(eval->Data.top()))
+        auto top = eval->Data.top();
+        eval->Data.pop();
+        if (is_value(top))
         {
-            auto v = as_value(eval->Data.top());
-            for (int i = 0; i < v->Stored.size() / 2; i++)
-                std::swap(v->Stored[i], v->Stored[v->Stored.size() - 1 - i]);
+            RegexProgram::Matcher matcher(*program);
+            eval->Data.push(f(matcher, as_value(top)->View()));
+            return;
         }
-        else
+        auto& src = as_branch(top)->Branches;
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.resize(src.size());
+        Parallel::For(src.size(), [&](size_t begin, size_t end)
+            {
+                RegexProgram::Matcher matcher(*program);
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto v = dynamic_cast<const Value*>(src[i].get());
+                    if (v == nullptr)
+                        ExecutionEngineException::ThrowWraped("Branch as value argument", ExecutionEngineException::Level::Critical);
+                    r->Branches[i] = f(matcher, v->View());
+                }
+            });
+        eval->Data.push(r);
+    }
+    // Calls f(begin, end, groups) for every non overlapping match, an empty match right after a match is skipped
+    template<typename Found>
+    static void RegexScan(RegexProgram::Matcher& matcher, std::string_view text, Found f)
+    {
+        std::vector<long long> groups;
+        long long last = -1;
+        for (size_t from = 0; from <= text.size() && matcher.Search(text, from, groups);)
         {
-            auto v = as_branch(eval->Data.top());
-            for (int i = 0; i < v->Branches.size() / 2; i++)
-                std::swap(v->Branches[i], v->Branches[v->Branches.size() - 1 - i]);
+            if (groups[1] > groups[0] || groups[0] != last)
+                f((size_t)groups[0], (size_t)groups[1], groups);
+            last = groups[1];
+            from = groups[1] > groups[0] ? groups[1] : groups[1] + 1;
         }
     }
-    static void Copy(Evaluator* eval)
+    static void RegexTest(Evaluator* eval)
     {
-        eval->RequireTop();
-        eval->Data.push(eval->Data.top()->Copy());
+        RegexTop(eval, [](RegexProgram::Matcher& m, std::string_view v) -> sp<BranchBase>
+            {
+                return std::make_shared<Value>(m.Test(v) ? "1" : "0");
+            });
     }
-    static void Duplicate(Evaluator* eval)
+    static void RegexExtract(Evaluator* eval)
     {
-        eval->RequireIntegerTop();
-        int c = as_value(eval->Data.top())->ReadAs<int>();
-        eval->Data.pop();
-        for (int i = 1; i < c; i++)
-            eval->Data.push(eval->Data.top()->Copy());
+        RegexTop(eval, [](RegexProgram::Matcher& m, std::string_view v) -> sp<BranchBase>
+            {
+                sp<Branch> r = std::make_shared<Branch>();
+                std::vector<long long> groups;
+                if (m.Search(v, 0, groups))
+                    for (size_t g = 0; g < groups.size(); g += 2)
+                        r->Branches.push_back(Value::Make(groups[g] < 0 ? std::string_view() : v.substr(groups[g], groups[g + 1] - groups[g])));
+                return r;
+            });
     }
-    static void DeepRemove(Evaluator* eval)
+    static void RegexMatchAll(Evaluator* eval)
     {
-        eval->RequireIntegerTop();
-        int c = as_value(eval->Data.top())->ReadAs<int>();
-        eval->Data.pop();
-        eval->RequireTop(c + 1);
-        std::stack<sp<BranchBase>> tmp;
-        for (int i = 0; i < c; i++)
-        {
-            tmp.push(eval->Data.top());
-            eval->Data.pop();
-        }
-        eval->Data.pop();
-        for (int i = 0; i < c; i++)
-        {
-            eval->Data.push(tmp.top());
-            tmp.pop();
-        }
+        RegexTop(eval, [](RegexProgram::Matcher& m, std::string_view v) -> sp<BranchBase>
+            {
+                sp<Branch> r = std::make_shared<Branch>();
+                RegexScan(m, v, [&](size_t begin, size_t end, const std::vector<long long>&)
+                    {
+                        r->Branches.push_back(Value::Make(v.substr(begin, end - begin)));
+                    });
+                return r;
+            });
     }
-    static void SplitRow(Evaluator* eval)
+    static void RegexSplit(Evaluator* eval)
+    {
+        RegexTop(eval, [](RegexProgram::Matcher& m, std::string_view v) -> sp<BranchBase>
+            {
+                sp<Branch> r = std::make_shared<Branch>();
+                size_t p = 0;
+                RegexScan(m, v, [&](size_t begin, size_t end, const std::vector<long long>&)
+                    {
+                        if (end == begin && (begin == 0 || begin == v.size()))
+                            return;
+                        r->Branches.push_back(Value::Make(v.substr(p, begin - p)));
+                        p = end;
+                    });
+                r->Branches.push_back(Value::Make(v.substr(p)));
+                return r;
+            });
+    }
+    static sp<Branch> FragmentationRow(const Fragmentation& f)
     {
-        eval->RequireValueTop();
-        std::string split = as_value(eval->Data.top())->Stored;
-        if (split.size() == 0)
-            ExecutionEngineException::ThrowWraped("Empty passed as split", ExecutionEngineException::Level::Critical);
-        eval->Data.pop();
-        eval->RequireValueTop();
-        std::string value = as_value(eval->Data.top())->Stored;
-        eval->Data.pop();
         sp<Branch> r = std::make_shared<Branch>();
-        int p = 0;
-        int np = value.find(split, p);
-        if (np == std::string::npos)
-            np = value.size();
-        while (np != value.size())
-        {
-            r->Branches.push_back(std::make_shared<Value>(value.substr(p, np - p)));
-            p = np + split.size();
-            np = value.find(split, p);
-            if (np == std::string::npos)
-                np = value.size();
-        }
-        r->Branches.push_back(std::make_shared<Value>(value.substr(p, np - p)));
-        eval->Data.push(r);
+        r->Branches.push_back(Value::Make(std::to_string(f.Nodes)));
+        r->Branches.push_back(Value::Make(std::to_string(f.Span)));
+        r->Branches.push_back(Value::Make(NumberText::Format(f.MeanStride)));
+        r->Branches.push_back(Value::Make(std::to_string(f.FarJumps)));
+        return r;
     }
-    static void ConcatRow(Evaluator* eval)
+    // Compacts the top and pushes its layout before and after: nodes, span, mean stride, far jumps
+    static void CompactTop(Evaluator* eval)
     {
-        eval->RequireValueTop();
-        std::string space = as_value(eval->Data.top())->Stored;
-        eval->Data.pop();
-        eval->RequireBranchTop();
-        sp<Branch> br = as_branch(eval->Data.top());
-        eval->Data.pop();
-        std::stringstream str;
-        bool f = false;
-        for (auto& i : br->Branches)
-        {
-            if (i->Depth() == 0)
-            {
-                if (!f)
-                    f = true;
-                else
-                    str << space;
-                str << as_value(i)->Stored;
-            }
-        }
-        eval->Data.push(std::make_shared<Value>(str.str()));
+        auto report = eval->Compact();
+        sp<Branch> r = std::make_shared<Branch>();
+        r->Branches.push_back(FragmentationRow(report.first));
+        r->Branches.push_back(FragmentationRow(report.second));
+        eval->Data.push(r);
     }
     static void MergeBranches(Evaluator* eval)
     {
         eval->RequireIntegerTop();
-        int depth = as_value(eval->Data.top())->ReadAs<int>();
+        int depth = Value::Read<int>(eval->Data.top().View());
 
     }
 #pragma endregion
@@ -8,7 +8,7 @@ void Print(Evaluator* eval)
 void System(Evaluator* eval)
 {
 	eval->RequireValueTop();
-	std::system(as_value(eval->Data.top())->Stored.c_str());
+	std::system(std::string(as_value(eval->Data.top())->View()).c_str());
 	eval->Data.pop();
 }
 void Exit(Evaluator* eval)